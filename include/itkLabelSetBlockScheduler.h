@@ -0,0 +1,157 @@
+/*=========================================================================
+ *
+ *  Copyright Insight Software Consortium
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+#ifndef itkLabelSetBlockScheduler_h
+#define itkLabelSetBlockScheduler_h
+
+#include "itkIntTypes.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// Hands out the blocks of lines of a pass to the work units. Each
+// work unit starts with a contiguous range of blocks, of about equal
+// cost, and takes them from the front. When its range is empty it
+// steals the back half of another's. A range is two 32 bit block
+// numbers in one atomic word, so taking and stealing are a single
+// compare and swap. A block only leaves the front of a range by being
+// taken, so a range never returns to an earlier value.
+namespace itk
+{
+namespace LabSet
+{
+class BlockScheduler
+{
+public:
+  BlockScheduler() :
+    m_NumberOfWorkers(0), m_Steals(0)
+  {}
+
+  // cost holds an estimate for each block, or is empty if they cost
+  // the same
+  void Initialize(const unsigned workers, const SizeValueType blocks, const std::vector< double > & cost)
+  {
+    m_NumberOfWorkers = std::max(1u, workers);
+    m_Ranges.reset(new Range[m_NumberOfWorkers]);
+
+    double total = 0;
+    for ( SizeValueType b = 0; b < blocks; b++ )
+      {
+      total += cost.empty() ? 1.0 : cost[b];
+      }
+    // worker w starts at the first block whose preceding cost reaches
+    // w / workers of the total
+    SizeValueType first = 0;
+    SizeValueType b = 0;
+    double        sum = 0;
+    for ( unsigned w = 0; w < m_NumberOfWorkers; w++ )
+      {
+      const double target = total * ( w + 1 ) / m_NumberOfWorkers;
+      while ( b < blocks && ( w + 1 == m_NumberOfWorkers || sum < target ) )
+        {
+        sum += cost.empty() ? 1.0 : cost[b];
+        ++b;
+        }
+      m_Ranges[w].span.store( Pack(first, b) );
+      first = b;
+      }
+    m_Steals = 0;
+  }
+
+  // the next block for worker, false when there are none left
+  bool Take(const unsigned worker, SizeValueType & block)
+  {
+    Range & own = m_Ranges[worker];
+
+    uint64_t span = own.span.load();
+    while ( Begin(span) < End(span) )
+      {
+      if ( own.span.compare_exchange_weak( span, Pack(Begin(span) + 1, End(span)) ) )
+        {
+        block = Begin(span);
+        return true;
+        }
+      }
+
+    // steal the back half of the first range that has anything left
+    for ( unsigned k = 1; k < m_NumberOfWorkers; k++ )
+      {
+      Range & victim = m_Ranges[( worker + k ) % m_NumberOfWorkers];
+      span = victim.span.load();
+      while ( Begin(span) < End(span) )
+        {
+        const SizeValueType mid = Begin(span) + ( End(span) - Begin(span) ) / 2;
+        if ( victim.span.compare_exchange_weak( span, Pack(Begin(span), mid) ) )
+          {
+          own.span.store( Pack(mid + 1, End(span)) );
+          ++m_Steals;
+          block = mid;
+          return true;
+          }
+        }
+      }
+    return false;
+  }
+
+  // the blocks worker has left, which before the first Take are its
+  // starting share
+  void GetRange(const unsigned worker, SizeValueType & begin, SizeValueType & end) const
+  {
+    const uint64_t span = m_Ranges[worker].span.load();
+    begin = Begin(span);
+    end = End(span);
+  }
+
+  SizeValueType GetNumberOfSteals() const
+  {
+    return m_Steals;
+  }
+
+private:
+  // a cache line each, so the work units don't share one. Padded
+  // rather than aligned, as new only honours the alignment from C++17
+  struct Range
+  {
+    std::atomic< uint64_t > span;
+    char                    pad[64 - sizeof( std::atomic< uint64_t > )];
+  };
+
+  static uint64_t Pack(const SizeValueType begin, const SizeValueType end)
+  {
+    return ( static_cast< uint64_t >( begin ) << 32 ) | static_cast< uint64_t >( end );
+  }
+
+  static SizeValueType Begin(const uint64_t span)
+  {
+    return static_cast< SizeValueType >( span >> 32 );
+  }
+
+  static SizeValueType End(const uint64_t span)
+  {
+    return static_cast< SizeValueType >( span & 0xffffffffu );
+  }
+
+  unsigned                     m_NumberOfWorkers;
+  std::unique_ptr< Range[] >   m_Ranges;
+  std::atomic< SizeValueType > m_Steals;
+};
+}
+}
+#endif
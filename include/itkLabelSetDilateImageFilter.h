@@ -81,10 +81,28 @@ protected:
     { this->DynamicMultiThreadingOn(); }
   ~LabelSetDilateImageFilter() override {}
 
-  void DynamicThreadedGenerateData(const OutputImageRegionType & outputRegionForThread) override;
+  using PassType = typename Superclass::PassType;
+
+  void ThreadedPass(const OutputImageRegionType & outputRegionForThread, const PassType & pass) override;
 
 private:
+  template< typename TDistanceImage >
+  void IntegerPass(const OutputImageRegionType & region, const PassType & pass, TDistanceImage *distanceImage,
+                   const SmartPointer< TDistanceImage > *rotatedDistance, LabSet::ScratchArena & arena);
+
+  // the per-line work of a floating point pass, whichever images the
+  // iterators are on
+  template< typename TInputIterator, typename TLabelIterator, typename TDistIterator,
+            typename TOutputDistIterator, typename TOutputIterator >
+  void FloatPass(const OutputImageRegionType & region, const PassType & pass, TInputIterator & inputIterator,
+                 TLabelIterator & inputIteratorStage2, TDistIterator & inputDistIterator,
+                 TOutputDistIterator & outputDistIterator, TOutputIterator & outputIterator,
+                 LabSet::ScratchArena & arena);
+
   using DistanceImageType = typename Superclass::DistanceImageType;
+  using IntegerDistanceType = typename Superclass::IntegerDistanceType;
+  using InterleavedPixelType = typename Superclass::InterleavedPixelType;
+  using InterleavedImageType = typename Superclass::InterleavedImageType;
 };
 } // end namespace itk
 
@@ -22,17 +22,86 @@
 #include "itkImageRegionConstIterator.h"
 #include "itkImageRegionIterator.h"
 
-#include "itkImageLinearIteratorWithIndex.h"
-#include "itkImageLinearConstIteratorWithIndex.h"
-
-#include "itkLabelSetUtils.h"
+#include "itkLabelSetLineAccess.h"
+#include "itkLabelSetLaneUtils.h"
+#include "itkLabelSetIntegerUtils.h"
 
 namespace itk
 {
+template< typename TInputImage, typename TOutputImage >
+template< typename TDistanceImage >
+void
+LabelSetDilateImageFilter< TInputImage, TOutputImage >
+::IntegerPass(const OutputImageRegionType & region, const PassType & pass, TDistanceImage *distanceImage,
+              const SmartPointer< TDistanceImage > *rotatedDistance, LabSet::ScratchArena & arena)
+{
+  // exact passes for radii in voxels. Every dimension is processed, a
+  // zero radius just doesn't spread. The distance image may be 16 or
+  // 32 bits, the lines are always processed in 32 bits.
+  using InputConstIteratorType = LabSet::LineAccessor< const TInputImage >;
+  using OutputIteratorType = LabSet::LineAccessor< TOutputImage >;
+
+  using InputDistIteratorType = LabSet::LineAccessor< const TDistanceImage >;
+  using OutputDistIteratorType = LabSet::LineAccessor< TDistanceImage >;
+
+  typename TInputImage::ConstPointer inputImage( this->GetInput () );
+  typename TOutputImage::Pointer     outputImage( this->GetPassOutput() );
+
+  // strided lines are read and written a tile at a time
+  const unsigned TileLines = this->m_TileLines[pass.Dimension];
+
+  // the images of the usual layout or the rotated buffers
+  const unsigned *readLayout = pass.ReadLayout.GetDataPointer();
+  const unsigned *writeLayout = pass.WriteLayout.GetDataPointer();
+  TOutputImage *  inputLabels = this->GetPassImage(outputImage.GetPointer(), this->m_RotatedLabelImage,
+                                                   pass.ReadBuffer);
+  TOutputImage *  outputLabels = this->GetPassImage(outputImage.GetPointer(), this->m_RotatedLabelImage,
+                                                    pass.WriteBuffer);
+  TDistanceImage *inputDistance = this->GetPassImage(distanceImage, rotatedDistance, pass.ReadBuffer);
+  TDistanceImage *outputDistance = this->GetPassImage(distanceImage, rotatedDistance, pass.WriteBuffer);
+
+  InputConstIteratorType inputIterator(inputImage, nullptr, writeLayout, region, TileLines, arena);
+  InputConstIteratorType inputIteratorStage2(inputLabels, readLayout, writeLayout, region, TileLines, arena);
+  OutputIteratorType     outputIterator(outputLabels, writeLayout, writeLayout, region, TileLines, arena);
+
+  InputDistIteratorType  inputDistIterator(inputDistance, readLayout, writeLayout, region, TileLines, arena);
+  OutputDistIteratorType outputDistIterator(outputDistance, writeLayout, writeLayout, region, TileLines, arena);
+
+  const unsigned long       LineLength = region.GetSize()[pass.Dimension];
+  const IntegerDistanceType weight = this->m_IntegerWeight[pass.Dimension];
+  if ( !pass.FirstPassDone )
+    {
+    LabSet::doOneDimensionDilateFirstPassInt< InputConstIteratorType, OutputDistIteratorType, OutputIteratorType,
+                                              IntegerDistanceType >(inputIterator, outputDistIterator,
+                                                                    outputIterator,
+                                                                    LineLength,
+                                                                    pass.Dimension,
+                                                                    weight,
+                                                                    this->m_IntegerCap,
+                                                                    arena);
+    }
+  else
+    {
+    LabSet::doOneDimensionDilateInt< InputConstIteratorType,
+                                     InputDistIteratorType,
+                                     OutputIteratorType,
+                                     OutputDistIteratorType,
+                                     IntegerDistanceType >(inputIteratorStage2,
+                                                           inputDistIterator,
+                                                           outputDistIterator,
+                                                           outputIterator,
+                                                           LineLength,
+                                                           pass.Dimension,
+                                                           weight,
+                                                           this->m_IntegerCap,
+                                                           arena);
+    }
+}
+
 template< typename TInputImage, typename TOutputImage >
 void
 LabelSetDilateImageFilter< TInputImage, TOutputImage >
-::DynamicThreadedGenerateData(const OutputImageRegionType & outputRegionForThread)
+::ThreadedPass(const OutputImageRegionType & outputRegionForThread, const PassType & pass)
 {
   // this is where the work happens. We use a distance image with
   // floating point pixel to perform the parabolic operations. The
@@ -43,11 +112,11 @@ LabelSetDilateImageFilter< TInputImage, TOutputImage >
   // Similarly, the thresholding on output needs to be integrated
   // with the last processing stage.
 
-  using InputConstIteratorType = ImageLinearConstIteratorWithIndex< TInputImage  >;
-  using OutputIteratorType = ImageLinearIteratorWithIndex< TOutputImage >;
+  using InputConstIteratorType = LabSet::LineAccessor< const TInputImage >;
+  using OutputIteratorType = LabSet::LineAccessor< TOutputImage >;
 
-  using InputDistIteratorType = ImageLinearConstIteratorWithIndex< DistanceImageType >;
-  using OutputDistIteratorType = ImageLinearIteratorWithIndex< DistanceImageType >;
+  using InputDistIteratorType = LabSet::LineAccessor< const DistanceImageType >;
+  using OutputDistIteratorType = LabSet::LineAccessor< DistanceImageType >;
 
   // for stages after the first
   // using OutputConstIteratorType = ImageLinearConstIteratorWithIndex< TOutputImage  > ;
@@ -55,62 +124,179 @@ LabelSetDilateImageFilter< TInputImage, TOutputImage >
   using RegionType = ImageRegion< TInputImage::ImageDimension >;
 
   typename TInputImage::ConstPointer inputImage( this->GetInput () );
-  typename TOutputImage::Pointer     outputImage( this->GetOutput() );
+  typename TOutputImage::Pointer     outputImage( this->GetPassOutput() );
+
+  // line buffers for this work unit
+  LabSet::ScratchLease   lease(this->m_ScratchPool);
+  LabSet::ScratchArena & arena = lease.GetArena();
+
+  if ( this->m_IntegerPasses )
+    {
+    if ( this->m_CompactPasses )
+      {
+      this->IntegerPass(outputRegionForThread, pass, this->m_CompactDistanceImage.GetPointer(),
+                        this->m_RotatedCompactDistanceImage, arena);
+      }
+    else
+      {
+      this->IntegerPass(outputRegionForThread, pass, this->m_IntegerDistanceImage.GetPointer(),
+                        this->m_RotatedIntegerDistanceImage, arena);
+      }
+    return;
+    }
 
-  outputImage->SetBufferedRegion( outputImage->GetRequestedRegion() );
-  outputImage->Allocate();
   RegionType region = outputRegionForThread;
 
-  InputConstIteratorType inputIterator(inputImage,  region);
-  InputConstIteratorType inputIteratorStage2(outputImage,  region);
-  OutputIteratorType     outputIterator(outputImage, region);
+  // strided lines are read and written a tile at a time
+  const unsigned TileLines = this->m_TileLines[pass.Dimension];
+
+  const unsigned *writeLayout = pass.WriteLayout.GetDataPointer();
+
+  InputConstIteratorType inputIterator(inputImage, nullptr, writeLayout, region, TileLines, arena);
+
+  if ( this->m_InterleavedPasses )
+    {
+    // the distances and labels are read from the pairs and written
+    // back there, until the last pass writes the labels to the output
+    using PairLabelIteratorType =
+      LabSet::LineAccessor< const InterleavedImageType, LabSet::LabelField< InterleavedPixelType > >;
+    using PairDistIteratorType =
+      LabSet::LineAccessor< const InterleavedImageType, LabSet::DistanceField< InterleavedPixelType > >;
+    using PairOutputLabelIteratorType =
+      LabSet::LineAccessor< InterleavedImageType, LabSet::LabelField< InterleavedPixelType > >;
+    using PairOutputDistIteratorType =
+      LabSet::LineAccessor< InterleavedImageType, LabSet::DistanceField< InterleavedPixelType > >;
+
+    InterleavedImageType *pairs = this->m_InterleavedImage;
+
+    PairLabelIteratorType      pairLabelIterator(pairs, region, TileLines, arena);
+    PairDistIteratorType       pairDistIterator(pairs, region, TileLines, arena);
+    PairOutputDistIteratorType pairOutputDistIterator(pairs, region, TileLines, arena);
+    if ( pass.LastPass )
+      {
+      OutputIteratorType outputIterator(outputImage, region, TileLines, arena);
+      this->FloatPass(region, pass, inputIterator, pairLabelIterator, pairDistIterator, pairOutputDistIterator,
+                      outputIterator, arena);
+      }
+    else
+      {
+      PairOutputLabelIteratorType pairOutputIterator(pairs, region, TileLines, arena);
+      this->FloatPass(region, pass, inputIterator, pairLabelIterator, pairDistIterator, pairOutputDistIterator,
+                      pairOutputIterator, arena);
+      }
+    return;
+    }
+
+  // the images of the usual layout or the rotated buffers
+  const unsigned *   readLayout = pass.ReadLayout.GetDataPointer();
+  TOutputImage *     inputLabels = this->GetPassImage(outputImage.GetPointer(), this->m_RotatedLabelImage,
+                                                      pass.ReadBuffer);
+  TOutputImage *     outputLabels = this->GetPassImage(outputImage.GetPointer(), this->m_RotatedLabelImage,
+                                                       pass.WriteBuffer);
+  DistanceImageType *inputDistance =
+    this->GetPassImage(this->m_DistanceImage.GetPointer(), this->m_RotatedDistanceImage, pass.ReadBuffer);
+  DistanceImageType *outputDistance =
+    this->GetPassImage(this->m_DistanceImage.GetPointer(), this->m_RotatedDistanceImage, pass.WriteBuffer);
+
+  InputConstIteratorType inputIteratorStage2(inputLabels, readLayout, writeLayout, region, TileLines, arena);
+  OutputIteratorType     outputIterator(outputLabels, writeLayout, writeLayout, region, TileLines, arena);
   //OutputConstIteratorType inputIteratorStage2( outputImage, region );
 
-  InputDistIteratorType  inputDistIterator(this->m_DistanceImage, region);
-  OutputDistIteratorType outputDistIterator(this->m_DistanceImage, region);
+  InputDistIteratorType  inputDistIterator(inputDistance, readLayout, writeLayout, region, TileLines, arena);
+  OutputDistIteratorType outputDistIterator(outputDistance, writeLayout, writeLayout, region, TileLines, arena);
 
+  this->FloatPass(region, pass, inputIterator, inputIteratorStage2, inputDistIterator, outputDistIterator,
+                  outputIterator, arena);
+}
+
+template< typename TInputImage, typename TOutputImage >
+template< typename TInputIterator, typename TLabelIterator, typename TDistIterator, typename TOutputDistIterator,
+          typename TOutputIterator >
+void
+LabelSetDilateImageFilter< TInputImage, TOutputImage >
+::FloatPass(const OutputImageRegionType & region, const PassType & pass, TInputIterator & inputIterator,
+            TLabelIterator & inputIteratorStage2, TDistIterator & inputDistIterator,
+            TOutputDistIterator & outputDistIterator, TOutputIterator & outputIterator,
+            LabSet::ScratchArena & arena)
+{
   // setup the progress reporting
   // deal with the first dimension - this should be copied to the
   // output if the scale is 0
 
   // flag to indicate whether the internal distance image has been
   // initialized using the special first pass erosion
-  if ( this->m_Scale[this->m_CurrentDimension] > 0 )
+  if ( this->m_Scale[pass.Dimension] > 0 )
     {
     // Perform as normal
     //RealType magnitude = 1.0/(2.0 * m_Scale[0]);
-    unsigned long LineLength = region.GetSize()[this->m_CurrentDimension];
-    RealType      image_scale = this->GetInput()->GetSpacing()[this->m_CurrentDimension];
+    unsigned long LineLength = region.GetSize()[pass.Dimension];
+    RealType      image_scale = this->GetInput()->GetSpacing()[pass.Dimension];
     //bool lastpass = (m_CurrentDimension == ImageDimension - 1);
 
-    if ( !this->m_FirstPassDone )
+    if ( !pass.FirstPassDone && this->m_NumberOfLanes > 0 )
+      {
+      LabSet::doOneDimensionDilateFirstPassLanes< TInputIterator, TOutputDistIterator, TOutputIterator,
+                                                  RealType >(inputIterator, outputDistIterator, outputIterator,
+                                                             LineLength,
+                                                             pass.Dimension,
+                                                             this->m_MagnitudeSign,
+                                                             this->m_UseImageSpacing,
+                                                             image_scale,
+                                                             this->m_Scale[pass.Dimension],
+                                                             this->m_NumberOfLanes,
+                                                             arena);
+      }
+    else if ( !pass.FirstPassDone )
       {
-      LabSet::doOneDimensionDilateFirstPass< InputConstIteratorType, OutputDistIteratorType, OutputIteratorType,
+      LabSet::doOneDimensionDilateFirstPass< TInputIterator, TOutputDistIterator, TOutputIterator,
                                              RealType >(inputIterator, outputDistIterator, outputIterator,
                                                         LineLength,
-                                                        this->m_CurrentDimension,
+                                                        pass.Dimension,
                                                         this->m_MagnitudeSign,
                                                         this->m_UseImageSpacing,
                                                         image_scale,
-                                                        this->m_Scale[this->m_CurrentDimension]);
+                                                        this->m_Scale[pass.Dimension],
+                                                        arena);
+      }
+    else if ( this->m_NumberOfLanes > 0 && !this->m_UseEnvelopeAlgorithm )
+      {
+      LabSet::doOneDimensionDilateLanes< TLabelIterator,
+                                         TDistIterator,
+                                         TOutputIterator,
+                                         TOutputDistIterator,
+                                         RealType >(inputIteratorStage2,
+                                                    inputDistIterator,
+                                                    outputDistIterator,
+                                                    outputIterator,
+                                                    LineLength,
+                                                    pass.Dimension,
+                                                    this->m_MagnitudeSign,
+                                                    this->m_UseImageSpacing,
+                                                    this->m_Extreme,
+                                                    image_scale,
+                                                    this->m_Scale[pass.Dimension],
+                                                    this->m_NumberOfLanes,
+                                                    arena);
       }
     else
       {
-      LabSet::doOneDimensionDilate< InputConstIteratorType,
-                                    InputDistIteratorType,
-                                    OutputIteratorType,
-                                    OutputDistIteratorType,
+      LabSet::doOneDimensionDilate< TLabelIterator,
+                                    TDistIterator,
+                                    TOutputIterator,
+                                    TOutputDistIterator,
                                     RealType >(inputIteratorStage2,
                                                inputDistIterator,
                                                outputDistIterator,
                                                outputIterator,
                                                LineLength,
-                                               this->m_CurrentDimension,
+                                               pass.Dimension,
                                                this->m_MagnitudeSign,
                                                this->m_UseImageSpacing,
                                                this->m_Extreme,
                                                image_scale,
-                                               this->m_Scale[this->m_CurrentDimension]);
+                                               this->m_Scale[pass.Dimension],
+                                               this->m_UseEnvelopeAlgorithm,
+                                               arena);
       }
     }
 }
@@ -86,11 +86,17 @@ protected:
     { this->DynamicMultiThreadingOn(); }
   ~LabelSetErodeImageFilter() override {}
 
-  void DynamicThreadedGenerateData(const OutputImageRegionType & outputRegionForThread) override;
+  using PassType = typename Superclass::PassType;
+
+  void ThreadedPass(const OutputImageRegionType & outputRegionForThread, const PassType & pass) override;
 
-  // Override since the filter produces the entire dataset.
 private:
+  template< typename TDistanceImage >
+  void IntegerPass(const OutputImageRegionType & region, const PassType & pass, TDistanceImage *distanceImage,
+                   const SmartPointer< TDistanceImage > *rotatedDistance, LabSet::ScratchArena & arena);
+
   using DistanceImageType = typename Superclass::DistanceImageType;
+  using IntegerDistanceType = typename Superclass::IntegerDistanceType;
 };
 } // end namespace itk
 
@@ -22,17 +22,101 @@
 #include "itkImageRegionConstIterator.h"
 #include "itkImageRegionIterator.h"
 
-#include "itkImageLinearIteratorWithIndex.h"
-#include "itkImageLinearConstIteratorWithIndex.h"
+#include "itkLabelSetLineAccess.h"
+#include "itkLabelSetLaneUtils.h"
+#include "itkLabelSetIntegerUtils.h"
 
-#include "itkLabelSetUtils.h"
+#include <memory>
 
 namespace itk
 {
 template< typename TInputImage, typename TOutputImage >
+template< typename TDistanceImage >
 void
 LabelSetErodeImageFilter< TInputImage, TOutputImage >
-::DynamicThreadedGenerateData(const OutputImageRegionType & outputRegionForThread)
+::IntegerPass(const OutputImageRegionType & region, const PassType & pass, TDistanceImage *distanceImage,
+              const SmartPointer< TDistanceImage > *rotatedDistance, LabSet::ScratchArena & arena)
+{
+  // exact passes for radii in voxels. Every dimension is processed, a
+  // zero radius just doesn't spread. The distance image may be 16 or
+  // 32 bits, the lines are always processed in 32 bits.
+  using InputConstIteratorType = LabSet::LineAccessor< const TInputImage >;
+  using OutputIteratorType = LabSet::LineAccessor< TOutputImage >;
+
+  using InputDistIteratorType = LabSet::LineAccessor< const TDistanceImage >;
+  using OutputDistIteratorType = LabSet::LineAccessor< TDistanceImage >;
+  using LabelCopyIteratorType = LabSet::LineAccessor< TInputImage >;
+
+  typename TInputImage::ConstPointer inputImage( this->GetInput () );
+  typename TOutputImage::Pointer     outputImage( this->GetPassOutput() );
+
+  // strided lines are read and written a tile at a time
+  const unsigned TileLines = this->m_TileLines[pass.Dimension];
+
+  // the images of the usual layout or the rotated buffers
+  const unsigned *readLayout = pass.ReadLayout.GetDataPointer();
+  const unsigned *writeLayout = pass.WriteLayout.GetDataPointer();
+  const TInputImage *labelImage = inputImage;
+  if ( pass.ReadBuffer >= 0 )
+    {
+    labelImage = this->m_RotatedLabelImage[pass.ReadBuffer];
+    }
+  TDistanceImage *inputDistance = this->GetPassImage(distanceImage, rotatedDistance, pass.ReadBuffer);
+  TDistanceImage *outputDistance = this->GetPassImage(distanceImage, rotatedDistance, pass.WriteBuffer);
+
+  InputConstIteratorType inputIterator(labelImage, readLayout, writeLayout, region, TileLines, arena);
+  OutputIteratorType     outputIterator(outputImage, nullptr, writeLayout, region, TileLines, arena);
+
+  InputDistIteratorType  inputDistIterator(inputDistance, readLayout, writeLayout, region, TileLines, arena);
+  OutputDistIteratorType outputDistIterator(outputDistance, writeLayout, writeLayout, region, TileLines, arena);
+
+  // the labels are carried along to the next pass's layout
+  std::unique_ptr< LabelCopyIteratorType > labelCopy;
+  if ( pass.WriteBuffer >= 0 )
+    {
+    labelCopy.reset( new LabelCopyIteratorType(this->m_RotatedLabelImage[pass.WriteBuffer], writeLayout,
+                                               writeLayout, region, TileLines, arena) );
+    inputIterator.SetCopyTarget( labelCopy.get() );
+    }
+
+  const unsigned long       LineLength = region.GetSize()[pass.Dimension];
+  const IntegerDistanceType weight = this->m_IntegerWeight[pass.Dimension];
+  const bool                lastpass = pass.LastPass;
+  if ( !pass.FirstPassDone )
+    {
+    LabSet::doOneDimensionErodeFirstPassInt< InputConstIteratorType, OutputDistIteratorType, OutputIteratorType,
+                                             IntegerDistanceType >(inputIterator, outputDistIterator,
+                                                                   outputIterator,
+                                                                   LineLength,
+                                                                   pass.Dimension,
+                                                                   weight,
+                                                                   this->m_IntegerCap,
+                                                                   lastpass,
+                                                                   arena);
+    }
+  else
+    {
+    LabSet::doOneDimensionErodeInt< InputConstIteratorType,
+                                    InputDistIteratorType,
+                                    OutputIteratorType,
+                                    OutputDistIteratorType,
+                                    IntegerDistanceType >(inputIterator,
+                                                          inputDistIterator,
+                                                          outputDistIterator,
+                                                          outputIterator,
+                                                          LineLength,
+                                                          pass.Dimension,
+                                                          weight,
+                                                          this->m_IntegerCap,
+                                                          lastpass,
+                                                          arena);
+    }
+}
+
+template< typename TInputImage, typename TOutputImage >
+void
+LabelSetErodeImageFilter< TInputImage, TOutputImage >
+::ThreadedPass(const OutputImageRegionType & outputRegionForThread, const PassType & pass)
 {
   // this is where the work happens. We use a distance image with
   // floating point pixel to perform the parabolic operations. The
@@ -43,27 +127,70 @@ LabelSetErodeImageFilter< TInputImage, TOutputImage >
   // Similarly, the thresholding on output needs to be integrated
   // with the last processing stage.
 
-  using InputConstIteratorType = ImageLinearConstIteratorWithIndex< TInputImage  >;
-  using OutputIteratorType = ImageLinearIteratorWithIndex< TOutputImage >;
+  using InputConstIteratorType = LabSet::LineAccessor< const TInputImage >;
+  using OutputIteratorType = LabSet::LineAccessor< TOutputImage >;
 
-  using InputDistIteratorType = ImageLinearConstIteratorWithIndex< DistanceImageType >;
-  using OutputDistIteratorType = ImageLinearIteratorWithIndex< DistanceImageType >;
+  using InputDistIteratorType = LabSet::LineAccessor< const DistanceImageType >;
+  using OutputDistIteratorType = LabSet::LineAccessor< DistanceImageType >;
+  using LabelCopyIteratorType = LabSet::LineAccessor< TInputImage >;
 
   using RegionType = ImageRegion< TInputImage::ImageDimension >;
 
   typename TInputImage::ConstPointer inputImage( this->GetInput () );
-  typename TOutputImage::Pointer     outputImage( this->GetOutput() );
+  typename TOutputImage::Pointer     outputImage( this->GetPassOutput() );
+
+  // line buffers for this work unit
+  LabSet::ScratchLease   lease(this->m_ScratchPool);
+  LabSet::ScratchArena & arena = lease.GetArena();
+
+  if ( this->m_IntegerPasses )
+    {
+    if ( this->m_CompactPasses )
+      {
+      this->IntegerPass(outputRegionForThread, pass, this->m_CompactDistanceImage.GetPointer(),
+                        this->m_RotatedCompactDistanceImage, arena);
+      }
+    else
+      {
+      this->IntegerPass(outputRegionForThread, pass, this->m_IntegerDistanceImage.GetPointer(),
+                        this->m_RotatedIntegerDistanceImage, arena);
+      }
+    return;
+    }
 
-  outputImage->SetBufferedRegion( outputImage->GetRequestedRegion() );
-  outputImage->Allocate();
   RegionType region = outputRegionForThread;
 
-  InputConstIteratorType inputIterator(inputImage,  region);
-  OutputIteratorType     outputIterator(outputImage, region);
+  // strided lines are read and written a tile at a time
+  const unsigned TileLines = this->m_TileLines[pass.Dimension];
+
+  // the images of the usual layout or the rotated buffers
+  const unsigned *readLayout = pass.ReadLayout.GetDataPointer();
+  const unsigned *writeLayout = pass.WriteLayout.GetDataPointer();
+  const TInputImage *labelImage = inputImage;
+  if ( pass.ReadBuffer >= 0 )
+    {
+    labelImage = this->m_RotatedLabelImage[pass.ReadBuffer];
+    }
+  DistanceImageType *inputDistance =
+    this->GetPassImage(this->m_DistanceImage.GetPointer(), this->m_RotatedDistanceImage, pass.ReadBuffer);
+  DistanceImageType *outputDistance =
+    this->GetPassImage(this->m_DistanceImage.GetPointer(), this->m_RotatedDistanceImage, pass.WriteBuffer);
+
+  InputConstIteratorType inputIterator(labelImage, readLayout, writeLayout, region, TileLines, arena);
+  OutputIteratorType     outputIterator(outputImage, nullptr, writeLayout, region, TileLines, arena);
   //OutputConstIteratorType inputIteratorStage2( outputImage, region );
 
-  InputDistIteratorType  inputDistIterator(this->m_DistanceImage, region);
-  OutputDistIteratorType outputDistIterator(this->m_DistanceImage, region);
+  InputDistIteratorType  inputDistIterator(inputDistance, readLayout, writeLayout, region, TileLines, arena);
+  OutputDistIteratorType outputDistIterator(outputDistance, writeLayout, writeLayout, region, TileLines, arena);
+
+  // the labels are carried along to the next pass's layout
+  std::unique_ptr< LabelCopyIteratorType > labelCopy;
+  if ( pass.WriteBuffer >= 0 )
+    {
+    labelCopy.reset( new LabelCopyIteratorType(this->m_RotatedLabelImage[pass.WriteBuffer], writeLayout,
+                                               writeLayout, region, TileLines, arena) );
+    inputIterator.SetCopyTarget( labelCopy.get() );
+    }
 
   // setup the progress reporting
   // deal with the first dimension - this should be copied to the
@@ -71,25 +198,62 @@ LabelSetErodeImageFilter< TInputImage, TOutputImage >
 
   // flag to indicate whether the internal distance image has been
   // initialized using the special first pass erosion
-  if ( this->m_Scale[this->m_CurrentDimension] > 0 )
+  if ( this->m_Scale[pass.Dimension] > 0 )
     {
     // Perform as normal
     //RealType magnitude = 1.0/(2.0 * m_Scale[0]);
-    unsigned long LineLength = region.GetSize()[this->m_CurrentDimension];
-    RealType      image_scale = this->GetInput()->GetSpacing()[this->m_CurrentDimension];
-    bool          lastpass = ( this->m_CurrentDimension == ImageDimension - 1 );
+    unsigned long LineLength = region.GetSize()[pass.Dimension];
+    RealType      image_scale = this->GetInput()->GetSpacing()[pass.Dimension];
+    bool          lastpass = pass.LastPass;
 
-    if ( !this->m_FirstPassDone )
+    if ( !pass.FirstPassDone && this->m_NumberOfLanes > 0 )
+      {
+      LabSet::doOneDimensionErodeFirstPassLanes< InputConstIteratorType, OutputDistIteratorType, OutputIteratorType,
+                                                 RealType >(inputIterator, outputDistIterator, outputIterator,
+                                                            LineLength,
+                                                            pass.Dimension,
+                                                            this->m_MagnitudeSign,
+                                                            this->m_UseImageSpacing,
+                                                            image_scale,
+                                                            this->m_Scale[pass.Dimension],
+                                                            lastpass,
+                                                            this->m_NumberOfLanes,
+                                                            arena);
+      }
+    else if ( !pass.FirstPassDone )
       {
       LabSet::doOneDimensionErodeFirstPass< InputConstIteratorType, OutputDistIteratorType, OutputIteratorType,
                                             RealType >(inputIterator, outputDistIterator, outputIterator,
                                                        LineLength,
-                                                       this->m_CurrentDimension,
+                                                       pass.Dimension,
                                                        this->m_MagnitudeSign,
                                                        this->m_UseImageSpacing,
                                                        image_scale,
-                                                       this->m_Scale[this->m_CurrentDimension],
-                                                       lastpass);
+                                                       this->m_Scale[pass.Dimension],
+                                                       lastpass,
+                                                       arena);
+      }
+    else if ( this->m_NumberOfLanes > 0 && !this->m_UseEnvelopeAlgorithm )
+      {
+      LabSet::doOneDimensionErodeLanes< InputConstIteratorType,
+                                        InputDistIteratorType,
+                                        OutputIteratorType,
+                                        OutputDistIteratorType,
+                                        RealType >(inputIterator,
+                                                   inputDistIterator,
+                                                   outputDistIterator,
+                                                   outputIterator,
+                                                   LineLength,
+                                                   pass.Dimension,
+                                                   this->m_MagnitudeSign,
+                                                   this->m_UseImageSpacing,
+                                                   this->m_Extreme,
+                                                   image_scale,
+                                                   this->m_Scale[pass.Dimension],
+                                                   this->m_BaseSigma,
+                                                   lastpass,
+                                                   this->m_NumberOfLanes,
+                                                   arena);
       }
     else
       {
@@ -103,14 +267,16 @@ LabelSetErodeImageFilter< TInputImage, TOutputImage >
                                               outputDistIterator,
                                               outputIterator,
                                               LineLength,
-                                              this->m_CurrentDimension,
+                                              pass.Dimension,
                                               this->m_MagnitudeSign,
                                               this->m_UseImageSpacing,
                                               this->m_Extreme,
                                               image_scale,
-                                              this->m_Scale[this->m_CurrentDimension],
+                                              this->m_Scale[pass.Dimension],
                                               this->m_BaseSigma,
-                                              lastpass);
+                                              lastpass,
+                                              this->m_UseEnvelopeAlgorithm,
+                                              arena);
       }
     }
 }
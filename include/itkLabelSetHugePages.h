@@ -0,0 +1,65 @@
+/*=========================================================================
+ *
+ *  Copyright Insight Software Consortium
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+#ifndef itkLabelSetHugePages_h
+#define itkLabelSetHugePages_h
+
+#include <cstddef>
+#include <cstdint>
+
+#if defined( __linux__ )
+#include <sys/mman.h>
+#endif
+
+// Asks the kernel to back a buffer with transparent huge pages, so a
+// pass striding through a large image needs far fewer TLB
+// entries. Only the 2 MB aligned stretches inside the buffer can be
+// backed this way, and only pages that haven't been touched yet are
+// affected, so it is done straight after allocation. A kernel without
+// transparent huge pages, or one where they are switched off, refuses
+// and the buffer keeps ordinary pages. Does nothing except on linux.
+namespace itk
+{
+namespace LabSet
+{
+static constexpr std::size_t HugePageBytes = std::size_t( 2 ) << 20;
+
+// true if the advice was taken
+inline bool AdviseHugePages(void *buffer, const std::size_t bytes)
+{
+#if defined( __linux__ ) && defined( MADV_HUGEPAGE )
+  if ( buffer == nullptr || bytes < HugePageBytes )
+    {
+    return false;
+    }
+  const std::uintptr_t first = reinterpret_cast< std::uintptr_t >( buffer );
+  const std::uintptr_t begin = ( first + HugePageBytes - 1 ) & ~( HugePageBytes - 1 );
+  const std::uintptr_t end = ( first + bytes ) & ~( HugePageBytes - 1 );
+  if ( begin >= end )
+    {
+    return false;
+    }
+  return madvise(reinterpret_cast< void * >( begin ), end - begin, MADV_HUGEPAGE) == 0;
+#else
+  (void)buffer;
+  (void)bytes;
+  return false;
+#endif
+}
+}
+}
+#endif
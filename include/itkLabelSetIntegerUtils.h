@@ -0,0 +1,417 @@
+/*=========================================================================
+ *
+ *  Copyright Insight Software Consortium
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+#ifndef itkLabelSetIntegerUtils_h
+#define itkLabelSetIntegerUtils_h
+
+#include "itkNumericTraits.h"
+#include "itkLabelSetScratchArena.h"
+
+#include <algorithm>
+
+// Exact integer versions of the per-line operations, used when the
+// radius is in voxels. Instead of Sigma - d^2 / 2 in floating point
+// the distance image holds the weighted squared distance
+// sum_i w_i * d_i^2 to the nearest label (dilation) or boundary
+// (erosion), saturated at Cap. A voxel is inside the structuring
+// element when the weighted squared distance is less than Cap, so
+// dilation labels voxels below Cap and erosion keeps the voxels that
+// stay at Cap. All the parabola arithmetic is done through the table
+// Q[k] = min(Cap, w * k^2) for the current dimension, and sums of two
+// saturated values fit in 32 bits because Cap < 2^31.
+namespace itk
+{
+namespace LabSet
+{
+template< class IntType >
+void FillIntegerParabola(IntType *Q, const unsigned LineLength,
+                         const IntType weight, const IntType Cap)
+{
+  // Q has room for LineLength + 1 entries
+  for ( unsigned k = 0; k <= LineLength; k++ )
+    {
+    const unsigned long long v = static_cast< unsigned long long >( weight ) * k * k;
+    Q[k] = static_cast< IntType >( std::min< unsigned long long >(v, Cap) );
+    }
+}
+
+template< class LineBufferType, class LabBufferType, class IntType, bool withLabels >
+void DoLineInt(LineBufferType & LineBuf, LineBufferType & tmpLineBuf,
+               LabBufferType & LabelBuf, LabBufferType & tmpLabelBuf,
+               const IntType *Q, const IntType Cap)
+{
+  // contact point algorithm, keeping the minimum. Ties go to the
+  // closest position, as in DoLineLabelProp.
+  long koffset = 0, newcontact = 0;
+
+  using LabelType = typename LabBufferType::ValueType;
+
+  const long LineLength = LineBuf.size();
+  // negative half of the parabola
+  for ( long pos = 0; pos < LineLength; pos++ )
+    {
+    IntType   BaseVal = NumericTraits< IntType >::max();
+    LabelType BaseLab = 0;
+    if ( withLabels )
+      {
+      BaseLab = LabelBuf[pos];
+      }
+    for ( long krange = koffset; krange <= 0; krange++ )
+      {
+      const IntType T = std::min< IntType >(Cap, LineBuf[pos + krange] + Q[-krange]);
+      if ( T <= BaseVal )
+        {
+        BaseVal = T;
+        newcontact = krange;
+        if ( withLabels )
+          {
+          BaseLab = LabelBuf[pos + krange];
+          }
+        }
+      }
+    tmpLineBuf[pos] = BaseVal;
+    if ( withLabels )
+      {
+      tmpLabelBuf[pos] = BaseLab;
+      }
+    koffset = newcontact - 1;
+    }
+  // positive half of parabola
+  koffset = newcontact = 0;
+  for ( long pos = LineLength - 1; pos >= 0; pos-- )
+    {
+    IntType   BaseVal = NumericTraits< IntType >::max();
+    LabelType BaseLab = 0;
+    if ( withLabels )
+      {
+      BaseLab = tmpLabelBuf[pos];
+      }
+    for ( long krange = koffset; krange >= 0; krange-- )
+      {
+      const IntType T = std::min< IntType >(Cap, tmpLineBuf[pos + krange] + Q[krange]);
+      if ( T <= BaseVal )
+        {
+        BaseVal = T;
+        newcontact = krange;
+        if ( withLabels )
+          {
+          BaseLab = tmpLabelBuf[pos + krange];
+          }
+        }
+      }
+    LineBuf[pos] = BaseVal;
+    if ( withLabels )
+      {
+      LabelBuf[pos] = BaseLab;
+      }
+    koffset = newcontact + 1;
+    }
+}
+
+template< class TInIter, class TOutDistIter, class TOutLabIter, class IntType >
+void doOneDimensionErodeFirstPassInt(TInIter & inputIterator, TOutDistIter & outputIterator,
+                                     TOutLabIter & outputLabIterator,
+                                     const unsigned LineLength,
+                                     const unsigned direction,
+                                     const IntType weight,
+                                     const IntType Cap,
+                                     const bool lastpass,
+                                     ScratchArena & arena)
+{
+  // closed form, as in doOneDimensionErodeFirstPass. Background is 0,
+  // each run gets the distance to the nearest end, and ends touching
+  // the image edge don't count.
+  using LineBufferType = ScratchBuffer< IntType >;
+  using LabelType = typename TInIter::PixelType;
+  using LabelBufferType = ScratchBuffer< LabelType >;
+
+  ScratchScope    scope(arena);
+  LineBufferType  LineBuf(arena, LineLength);
+  LabelBufferType LabBuf(arena, LineLength);
+  LineBufferType  Q(arena, LineLength + 1);
+  FillIntegerParabola(Q.begin(), LineLength, weight, Cap);
+
+  inputIterator.SetDirection(direction);
+  outputIterator.SetDirection(direction);
+  outputLabIterator.SetDirection(direction);
+
+  inputIterator.GoToBegin();
+  outputIterator.GoToBegin();
+  outputLabIterator.GoToBegin();
+
+  while ( !inputIterator.IsAtEnd() && !outputIterator.IsAtEnd() )
+    {
+    inputIterator.Gather( LabBuf.begin() );
+    std::fill(LineBuf.begin(), LineBuf.end(), 0);
+
+    for ( unsigned first = 0; first < LineLength; first++ )
+      {
+      const LabelType val = LabBuf[first];
+      if ( val == 0 )
+        {
+        continue;
+        }
+      unsigned last = first;
+      while ( last + 1 < LineLength && LabBuf[last + 1] == val )
+        {
+        ++last;
+        }
+      const IntType leftend = ( first == 0 ) ? Cap : 0;
+      const IntType rightend = ( last == LineLength - 1 ) ? Cap : 0;
+      for ( unsigned pos = first; pos <= last; pos++ )
+        {
+        const IntType left = std::min< IntType >(Cap, leftend + Q[pos - first + 1]);
+        const IntType right = std::min< IntType >(Cap, rightend + Q[last - pos + 1]);
+        LineBuf[pos] = std::min(left, right);
+        }
+      first = last;
+      }
+
+    outputIterator.Scatter( LineBuf.begin() );
+
+    if ( lastpass )
+      {
+      for ( unsigned j = 0; j < LineLength; j++ )
+        {
+        if ( LineBuf[j] != Cap )
+          {
+          LabBuf[j] = 0;
+          }
+        }
+      outputLabIterator.Scatter( LabBuf.begin() );
+      outputLabIterator.NextLine();
+      }
+
+    inputIterator.NextLine();
+    outputIterator.NextLine();
+    }
+}
+
+template< class TInIter, class TOutDistIter, class TOutLabIter, class IntType >
+void doOneDimensionDilateFirstPassInt(TInIter & inputIterator, TOutDistIter & outputIterator,
+                                      TOutLabIter & outputLabIterator,
+                                      const unsigned LineLength,
+                                      const unsigned direction,
+                                      const IntType weight,
+                                      const IntType Cap,
+                                      ScratchArena & arena)
+{
+  // labels start at 0 and background at Cap. Same single contact
+  // scheme as DoLineDilateFirstPass, keeping the minimum.
+  using LineBufferType = ScratchBuffer< IntType >;
+  using LabelType = typename TInIter::PixelType;
+  using LabelBufferType = ScratchBuffer< LabelType >;
+
+  ScratchScope    scope(arena);
+  LineBufferType  LineBuf(arena, LineLength);
+  LineBufferType  tmpLineBuf(arena, LineLength);
+  LabelBufferType LabBuf(arena, LineLength);
+  LabelBufferType NewLabBuf(arena, LineLength);
+  LineBufferType  Q(arena, LineLength + 1);
+  FillIntegerParabola(Q.begin(), LineLength, weight, Cap);
+
+  inputIterator.SetDirection(direction);
+  outputIterator.SetDirection(direction);
+  outputLabIterator.SetDirection(direction);
+
+  inputIterator.GoToBegin();
+  outputIterator.GoToBegin();
+  outputLabIterator.GoToBegin();
+
+  while ( !inputIterator.IsAtEnd() && !outputIterator.IsAtEnd() )
+    {
+    inputIterator.Gather( LabBuf.begin() );
+    for ( unsigned i = 0; i < LineLength; i++ )
+      {
+      LineBuf[i] = LabBuf[i] ? 0 : Cap;
+      }
+
+    long    lastcontact = 0;
+    IntType lastval = LineBuf[0];
+    for ( long pos = 0; pos < static_cast< long >( LineLength ); pos++ )
+      {
+      // left pass
+      const IntType thisval = std::min< IntType >(Cap, lastval + Q[pos - lastcontact]);
+      if ( LineBuf[pos] <= lastval )
+        {
+        lastcontact = pos;
+        lastval = LineBuf[pos];
+        }
+      tmpLineBuf[pos] = std::min(LineBuf[pos], thisval);
+      NewLabBuf[pos] = ( thisval < LineBuf[pos] ) ? LabBuf[lastcontact] : LabBuf[pos];
+      }
+
+    lastcontact = LineLength - 1;
+    lastval = tmpLineBuf[lastcontact];
+    for ( long pos = LineLength - 1; pos >= 0; pos-- )
+      {
+      // right pass
+      const IntType thisval = std::min< IntType >(Cap, lastval + Q[lastcontact - pos]);
+      if ( tmpLineBuf[pos] <= lastval )
+        {
+        lastcontact = pos;
+        lastval = tmpLineBuf[pos];
+        }
+      LineBuf[pos] = std::min(tmpLineBuf[pos], thisval);
+      if ( thisval < tmpLineBuf[pos] )
+        {
+        NewLabBuf[pos] = LabBuf[lastcontact];
+        }
+      }
+
+    outputIterator.Scatter( LineBuf.begin() );
+    outputLabIterator.Scatter( NewLabBuf.begin() );
+
+    inputIterator.NextLine();
+    outputIterator.NextLine();
+    outputLabIterator.NextLine();
+    }
+}
+
+template< class TInIter, class TDistIter, class TOutLabIter, class TOutDistIter, class IntType >
+void doOneDimensionErodeInt(TInIter & inputIterator, TDistIter & inputDistIterator,
+                            TOutDistIter & outputDistIterator, TOutLabIter & outputLabIterator,
+                            const unsigned LineLength,
+                            const unsigned direction,
+                            const IntType weight,
+                            const IntType Cap,
+                            const bool lastpass,
+                            ScratchArena & arena)
+{
+  // each label run is padded with the value beyond either end - 0 for
+  // a boundary, Cap for the image edge - as in doOneDimensionErode
+  using LineBufferType = ScratchBuffer< IntType >;
+  using LabelType = typename TInIter::PixelType;
+  using LabelBufferType = ScratchBuffer< LabelType >;
+
+  ScratchScope    scope(arena);
+  LineBufferType  LineBuf(arena, LineLength);
+  LabelBufferType LabBuf(arena, LineLength);
+  LineBufferType  Q(arena, LineLength + 2);
+  FillIntegerParabola(Q.begin(), LineLength + 1, weight, Cap);
+
+  inputIterator.SetDirection(direction);
+  outputDistIterator.SetDirection(direction);
+  inputDistIterator.SetDirection(direction);
+  outputLabIterator.SetDirection(direction);
+
+  inputIterator.GoToBegin();
+  outputDistIterator.GoToBegin();
+  inputDistIterator.GoToBegin();
+  outputLabIterator.GoToBegin();
+
+  while ( !inputIterator.IsAtEnd() && !outputDistIterator.IsAtEnd() )
+    {
+    inputDistIterator.Gather( LineBuf.begin() );
+    inputIterator.Gather( LabBuf.begin() );
+
+    for ( unsigned first = 0; first < LineLength; first++ )
+      {
+      const LabelType val = LabBuf[first];
+      if ( val == 0 )
+        {
+        continue;
+        }
+      unsigned last = first;
+      while ( last + 1 < LineLength && LabBuf[last + 1] == val )
+        {
+        ++last;
+        }
+      const unsigned SLL = last - first + 1;
+      ScratchScope   runScope(arena);
+      LineBufferType ShortLineBuf(arena, SLL + 2);
+      LineBufferType tmpShortLineBuf(arena, SLL + 2);
+      ShortLineBuf[0] = ( first == 0 ) ? Cap : 0;
+      ShortLineBuf[SLL + 1] = ( last == LineLength - 1 ) ? Cap : 0;
+      std::copy( &( LineBuf[first] ), &( LineBuf[last + 1] ), &( ShortLineBuf[1] ) );
+
+      DoLineInt< LineBufferType, LabelBufferType, IntType, false >(ShortLineBuf, tmpShortLineBuf,
+                                                                   LabBuf, LabBuf, Q.begin(), Cap);
+      std::copy( &( ShortLineBuf[1] ), &( ShortLineBuf[SLL + 1] ), &( LineBuf[first] ) );
+      first = last;
+      }
+
+    outputDistIterator.Scatter( LineBuf.begin() );
+
+    if ( lastpass )
+      {
+      for ( unsigned j = 0; j < LineLength; j++ )
+        {
+        if ( LineBuf[j] != Cap )
+          {
+          LabBuf[j] = 0;
+          }
+        }
+      outputLabIterator.Scatter( LabBuf.begin() );
+      outputLabIterator.NextLine();
+      }
+    inputIterator.NextLine();
+    inputDistIterator.NextLine();
+    outputDistIterator.NextLine();
+    }
+}
+
+template< class TInIter, class TDistIter, class TOutLabIter, class TOutDistIter, class IntType >
+void doOneDimensionDilateInt(TInIter & inputIterator, TDistIter & inputDistIterator,
+                             TOutDistIter & outputDistIterator, TOutLabIter & outputLabIterator,
+                             const unsigned LineLength,
+                             const unsigned direction,
+                             const IntType weight,
+                             const IntType Cap,
+                             ScratchArena & arena)
+{
+  using LineBufferType = ScratchBuffer< IntType >;
+  using LabelType = typename TInIter::PixelType;
+  using LabelBufferType = ScratchBuffer< LabelType >;
+
+  ScratchScope    scope(arena);
+  LineBufferType  LineBuf(arena, LineLength);
+  LineBufferType  tmpLineBuf(arena, LineLength);
+  LabelBufferType LabBuf(arena, LineLength);
+  LabelBufferType tmpLabBuf(arena, LineLength);
+  LineBufferType  Q(arena, LineLength + 1);
+  FillIntegerParabola(Q.begin(), LineLength, weight, Cap);
+
+  inputIterator.SetDirection(direction);
+  inputDistIterator.SetDirection(direction);
+  outputDistIterator.SetDirection(direction);
+  outputLabIterator.SetDirection(direction);
+
+  inputIterator.GoToBegin();
+  inputDistIterator.GoToBegin();
+  outputDistIterator.GoToBegin();
+  outputLabIterator.GoToBegin();
+
+  while ( !inputDistIterator.IsAtEnd() && !outputLabIterator.IsAtEnd() )
+    {
+    inputDistIterator.Gather( LineBuf.begin() );
+    inputIterator.Gather( LabBuf.begin() );
+
+    DoLineInt< LineBufferType, LabelBufferType, IntType, true >(LineBuf, tmpLineBuf, LabBuf, tmpLabBuf, Q.begin(), Cap);
+
+    outputDistIterator.Scatter( LineBuf.begin() );
+    outputLabIterator.Scatter( LabBuf.begin() );
+
+    inputIterator.NextLine();
+    outputLabIterator.NextLine();
+    inputDistIterator.NextLine();
+    outputDistIterator.NextLine();
+    }
+}
+}
+}
+#endif
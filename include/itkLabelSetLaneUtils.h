@@ -0,0 +1,758 @@
+/*=========================================================================
+ *
+ *  Copyright Insight Software Consortium
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+#ifndef itkLabelSetLaneUtils_h
+#define itkLabelSetLaneUtils_h
+
+#include "itkLabelSetUtils.h"
+#include "itkLabelSetScratchArena.h"
+#include "itkMacro.h"
+
+#include <algorithm>
+#include <utility>
+
+// Lockstep versions of the per-line operations. A block of lines (or
+// label runs for erosion) is transposed so that position pos of lane
+// l lives at Buf[pos * Lanes + l], and every lane runs the contact
+// point algorithm at the same time. The lane loops are written so the
+// compiler can vectorize them, and are instantiated for AVX2 and
+// AVX-512 using target attributes, with the instruction set chosen at
+// run time. Builds without the dispatch support report no lanes and
+// the filters use the scalar code.
+//
+// AVX-512 brings FMA with it, as does building for a cpu that has it,
+// and a fused a - m * k * k rounds differently to a separate product
+// and subtraction. Neither the kernels nor the scalar code multiply:
+// both look the parabola heights up in a table filled by FillParabola,
+// so there is nothing for the compiler to contract, and the kernels
+// match the scalar code bit for bit whatever the target flags.
+#if defined( __GNUC__ ) && ( defined( __x86_64__ ) || defined( __i386__ ) )
+#define ITK_LABELSET_LANE_DISPATCH 1
+#define ITK_LABELSET_FORCE_INLINE inline __attribute__( ( always_inline ) )
+#else
+#define ITK_LABELSET_LANE_DISPATCH 0
+#define ITK_LABELSET_FORCE_INLINE inline
+#endif
+
+namespace itk
+{
+namespace LabSet
+{
+/** number of lines processed in lockstep on this cpu, 0 if there is no
+ * vector support */
+inline unsigned GetNumberOfLanes()
+{
+#if ITK_LABELSET_LANE_DISPATCH
+  __builtin_cpu_init();
+  if ( __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw") )
+    {
+    return 16;
+    }
+  if ( __builtin_cpu_supports("avx2") )
+    {
+    return 8;
+    }
+#endif
+  return 0;
+}
+
+#if ITK_LABELSET_LANE_DISPATCH
+template< class TKernel, class ... TArgs >
+__attribute__( ( target("avx2") ) ) void
+RunLanesAVX2(TArgs ... args)
+{
+  TKernel::template Run< 8 >(args ...);
+}
+
+template< class TKernel, class ... TArgs >
+__attribute__( ( target("avx512f,avx512bw") ) ) void
+RunLanesAVX512(TArgs ... args)
+{
+  TKernel::template Run< 16 >(args ...);
+}
+#endif
+
+/** run a lockstep kernel with the number of lanes returned by
+ * GetNumberOfLanes. TKernel provides a static Run< Lanes > method */
+template< class TKernel, class ... TArgs >
+void RunLanes(const unsigned Lanes, TArgs ... args)
+{
+#if ITK_LABELSET_LANE_DISPATCH
+  if ( Lanes == 16 )
+    {
+    RunLanesAVX512< TKernel >(args ...);
+    return;
+    }
+  if ( Lanes == 8 )
+    {
+    RunLanesAVX2< TKernel >(args ...);
+    return;
+    }
+#endif
+  itkGenericExceptionMacro(<< "No lockstep kernel for " << Lanes << " lanes");
+}
+
+template< class RealType, class LabelType, bool doDilate, bool withLabels >
+struct LineLanesKernel
+{
+  template< unsigned Lanes >
+  static ITK_LABELSET_FORCE_INLINE void
+  Run(RealType *LineBuf, RealType *tmpLineBuf,
+      LabelType *LabelBuf, LabelType *tmpLabelBuf,
+      const int *LineLength, const RealType *Parabola, const RealType m_Extreme)
+  {
+    // contact point algorithm, as in DoLine/DoLineLabelProp, with the
+    // search range of each lane masked to its own contact point. The
+    // candidates and the order they are visited are the same as the
+    // scalar version, so the results are too. Lanes can have different
+    // lengths (zero for unused lanes) - they are all left aligned.
+    //
+    // The lane loops only select, with no branches and no label
+    // traffic, so the compiler turns them into vector compares and
+    // blends. Each position's search takes a candidate at least once,
+    // so the label is fetched from the contact point afterwards.
+    int MaxLength = 0;
+    int koffset[Lanes], newcontact[Lanes];
+
+    for ( unsigned l = 0; l < Lanes; l++ )
+      {
+      MaxLength = std::max(MaxLength, LineLength[l]);
+      koffset[l] = newcontact[l] = 0;
+      }
+
+    // negative half of the parabola
+    for ( int pos = 0; pos < MaxLength; pos++ )
+      {
+      RealType BaseVal[Lanes];
+      int      kmin = 0;
+      for ( unsigned l = 0; l < Lanes; l++ )
+        {
+        if ( pos < LineLength[l] )
+          {
+          kmin = std::min(kmin, koffset[l]);
+          }
+        BaseVal[l] = m_Extreme;
+        }
+      for ( int krange = kmin; krange <= 0; krange++ )
+        {
+        const RealType   P = Parabola[-krange];
+        const RealType * Src = LineBuf + ( pos + krange ) * Lanes;
+        for ( unsigned l = 0; l < Lanes; l++ )
+          {
+          const RealType T = Src[l] - P;
+          const bool     better = doDilate ? ( T >= BaseVal[l] ) : ( T <= BaseVal[l] );
+          const bool     take = better & ( krange >= koffset[l] );
+          BaseVal[l] = take ? T : BaseVal[l];
+          newcontact[l] = take ? krange : newcontact[l];
+          }
+        }
+      for ( unsigned l = 0; l < Lanes; l++ )
+        {
+        tmpLineBuf[pos * Lanes + l] = BaseVal[l];
+        if ( withLabels )
+          {
+          tmpLabelBuf[pos * Lanes + l] = LabelBuf[( pos + newcontact[l] ) * Lanes + l];
+          }
+        koffset[l] = newcontact[l] - 1;
+        }
+      }
+
+    // positive half of the parabola. Lanes join in as pos reaches their
+    // last position.
+    for ( unsigned l = 0; l < Lanes; l++ )
+      {
+      koffset[l] = newcontact[l] = 0;
+      }
+    for ( int pos = MaxLength - 1; pos >= 0; pos-- )
+      {
+      RealType BaseVal[Lanes];
+      int      kmax = 0;
+      for ( unsigned l = 0; l < Lanes; l++ )
+        {
+        if ( pos < LineLength[l] )
+          {
+          kmax = std::max(kmax, koffset[l]);
+          }
+        BaseVal[l] = m_Extreme;
+        }
+      for ( int krange = kmax; krange >= 0; krange-- )
+        {
+        const RealType   P = Parabola[krange];
+        const RealType * Src = tmpLineBuf + ( pos + krange ) * Lanes;
+        for ( unsigned l = 0; l < Lanes; l++ )
+          {
+          const RealType T = Src[l] - P;
+          const bool     better = doDilate ? ( T >= BaseVal[l] ) : ( T <= BaseVal[l] );
+          const bool     take = better & ( krange <= koffset[l] );
+          BaseVal[l] = take ? T : BaseVal[l];
+          newcontact[l] = take ? krange : newcontact[l];
+          }
+        }
+      for ( unsigned l = 0; l < Lanes; l++ )
+        {
+        LineBuf[pos * Lanes + l] = BaseVal[l];
+        if ( withLabels )
+          {
+          LabelBuf[pos * Lanes + l] = tmpLabelBuf[( pos + newcontact[l] ) * Lanes + l];
+          }
+        koffset[l] = ( pos < LineLength[l] ) ? newcontact[l] + 1 : 0;
+        }
+      }
+  }
+};
+
+/** DoLine/DoLineLabelProp for a block of Lanes lines. Parabola is
+ * filled by FillParabola and covers the longest line. */
+template< class RealType, class LabelType, bool doDilate, bool withLabels >
+void DoLineLanes(const unsigned Lanes,
+                 RealType *LineBuf, RealType *tmpLineBuf,
+                 LabelType *LabelBuf, LabelType *tmpLabelBuf,
+                 const int *LineLength, const RealType *Parabola, const RealType m_Extreme)
+{
+  RunLanes< LineLanesKernel< RealType, LabelType, doDilate, withLabels > >(Lanes, LineBuf, tmpLineBuf,
+                                                                          LabelBuf, tmpLabelBuf,
+                                                                          LineLength, Parabola, m_Extreme);
+}
+
+template< class RealType, class LabelType >
+struct ErodeFirstPassLanesKernel
+{
+  template< unsigned Lanes >
+  static ITK_LABELSET_FORCE_INLINE void
+  Run(RealType *LineBuf, const LabelType *LabBuf, const int LineLength,
+      const RealType *Parabola, const RealType Sigma)
+  {
+    // closed form first pass erosion, as in DoLineErodeFirstPass, but
+    // working on whole lines. The run containing each position is
+    // tracked on the way out (for the left parabola) and on the way
+    // back (for the right parabola), so no run list is needed.
+    int       first[Lanes], last[Lanes];
+    LabelType prev[Lanes];
+
+    for ( unsigned l = 0; l < Lanes; l++ )
+      {
+      first[l] = last[l] = 0;
+      prev[l] = 0;
+      }
+
+    for ( int pos = 0; pos < LineLength; pos++ )
+      {
+      for ( unsigned l = 0; l < Lanes; l++ )
+        {
+        const LabelType lab = LabBuf[pos * Lanes + l];
+        first[l] = ( pos == 0 || lab != prev[l] ) ? pos : first[l];
+        prev[l] = lab;
+        const RealType leftend = ( first[l] == 0 ) ? Sigma : 0;
+        LineBuf[pos * Lanes + l] = leftend - Parabola[pos - first[l] + 1];
+        }
+      }
+    for ( int pos = LineLength - 1; pos >= 0; pos-- )
+      {
+      for ( unsigned l = 0; l < Lanes; l++ )
+        {
+        const LabelType lab = LabBuf[pos * Lanes + l];
+        last[l] = ( pos == LineLength - 1 || lab != prev[l] ) ? pos : last[l];
+        prev[l] = lab;
+        const RealType rightend = ( last[l] == LineLength - 1 ) ? Sigma : 0;
+        const RealType right = rightend - Parabola[last[l] - pos + 1];
+        const RealType left = LineBuf[pos * Lanes + l];
+        const RealType val = std::min(std::min(left, right), Sigma);
+        LineBuf[pos * Lanes + l] = ( lab != 0 ) ? val : 0;
+        }
+      }
+  }
+};
+
+template< class RealType, class LabelType >
+struct DilateFirstPassLanesKernel
+{
+  template< unsigned Lanes >
+  static ITK_LABELSET_FORCE_INLINE void
+  Run(RealType *LineBuf, RealType *tmpLineBuf,
+      const LabelType *LabBuf, LabelType *NewLabBuf,
+      const int LineLength, const RealType *Parabola)
+  {
+    // DoLineDilateFirstPass for a block of lines. The value and label
+    // at the last contact are carried along with it, so there are no
+    // gathers.
+    int       lastcontact[Lanes];
+    RealType  lastval[Lanes];
+    LabelType lastlab[Lanes];
+
+    for ( unsigned l = 0; l < Lanes; l++ )
+      {
+      lastcontact[l] = 0;
+      lastval[l] = LineBuf[l];
+      lastlab[l] = LabBuf[l];
+      }
+    for ( int pos = 0; pos < LineLength; pos++ )
+      {
+      for ( unsigned l = 0; l < Lanes; l++ )
+        {
+        // left pass
+        const RealType  thisval = lastval[l] - Parabola[pos - lastcontact[l]];
+        const RealType  cur = LineBuf[pos * Lanes + l];
+        const LabelType lab = LabBuf[pos * Lanes + l];
+        const bool      contact = ( cur >= lastval[l] );
+        lastcontact[l] = contact ? pos : lastcontact[l];
+        lastval[l] = contact ? cur : lastval[l];
+        lastlab[l] = contact ? lab : lastlab[l];
+        tmpLineBuf[pos * Lanes + l] = std::max(cur, thisval);
+        NewLabBuf[pos * Lanes + l] = ( thisval > cur ) ? lastlab[l] : lab;
+        }
+      }
+
+    for ( unsigned l = 0; l < Lanes; l++ )
+      {
+      lastcontact[l] = LineLength - 1;
+      lastval[l] = tmpLineBuf[( LineLength - 1 ) * Lanes + l];
+      lastlab[l] = LabBuf[( LineLength - 1 ) * Lanes + l];
+      }
+    for ( int pos = LineLength - 1; pos >= 0; pos-- )
+      {
+      for ( unsigned l = 0; l < Lanes; l++ )
+        {
+        // right pass
+        const RealType thisval = lastval[l] - Parabola[lastcontact[l] - pos];
+        const RealType cur = tmpLineBuf[pos * Lanes + l];
+        const bool     contact = ( cur >= lastval[l] );
+        lastcontact[l] = contact ? pos : lastcontact[l];
+        lastval[l] = contact ? cur : lastval[l];
+        lastlab[l] = contact ? LabBuf[pos * Lanes + l] : lastlab[l];
+        LineBuf[pos * Lanes + l] = std::max(cur, thisval);
+        NewLabBuf[pos * Lanes + l] = ( thisval > cur ) ? lastlab[l] : NewLabBuf[pos * Lanes + l];
+        }
+      }
+  }
+};
+
+template< class TInIter, class TOutDistIter, class TOutLabIter, class RealType >
+void doOneDimensionErodeFirstPassLanes(TInIter & inputIterator, TOutDistIter & outputIterator,
+                                       TOutLabIter & outputLabIterator,
+                                       const unsigned LineLength,
+                                       const unsigned direction,
+                                       const int m_MagnitudeSign,
+                                       const bool m_UseImageSpacing,
+                                       const RealType image_scale,
+                                       const RealType Sigma,
+                                       const bool lastpass,
+                                       const unsigned Lanes,
+                                       ScratchArena & arena)
+{
+  // lockstep version of doOneDimensionErodeFirstPass. The labels are
+  // transposed into the block as they are read and the distances are
+  // computed from them directly.
+  using LabelType = typename TInIter::PixelType;
+  RealType iscale = 1.0;
+  if ( m_UseImageSpacing )
+    {
+    iscale = image_scale;
+    }
+  const RealType magnitude = ( m_MagnitudeSign * iscale * iscale ) / ( 2.0 );
+
+  ScratchScope              scope(arena);
+  ScratchBuffer< RealType >  LineBuf(arena, Lanes * LineLength);
+  ScratchBuffer< LabelType > LabBuf(arena, Lanes * LineLength);
+  ScratchBuffer< RealType >  Parabola(arena, LineLength + 1);
+  FillParabola(&( Parabola[0] ), LineLength + 1, magnitude);
+
+  inputIterator.SetDirection(direction);
+  outputIterator.SetDirection(direction);
+  outputLabIterator.SetDirection(direction);
+
+  inputIterator.GoToBegin();
+  outputIterator.GoToBegin();
+  outputLabIterator.GoToBegin();
+
+  while ( !inputIterator.IsAtEnd() && !outputIterator.IsAtEnd() )
+    {
+    unsigned BlockLines = 0;
+    while ( BlockLines < Lanes && !inputIterator.IsAtEnd() )
+      {
+      inputIterator.Gather(&( LabBuf[BlockLines] ), Lanes);
+      inputIterator.NextLine();
+      ++BlockLines;
+      }
+
+    RunLanes< ErodeFirstPassLanesKernel< RealType, LabelType > >(Lanes, &( LineBuf[0] ),
+                                                                 static_cast< const LabelType * >( &( LabBuf[0] ) ),
+                                                                 static_cast< int >( LineLength ),
+                                                                 static_cast< const RealType * >( &( Parabola[0] ) ),
+                                                                 Sigma);
+
+    for ( unsigned b = 0; b < BlockLines; b++ )
+      {
+      outputIterator.Scatter(&( LineBuf[b] ), Lanes);
+      outputIterator.NextLine();
+      if ( lastpass )
+        {
+        for ( unsigned j = 0; j < LineLength; j++ )
+          {
+          if ( LineBuf[j * Lanes + b] != Sigma )
+            {
+            LabBuf[j * Lanes + b] = 0;
+            }
+          }
+        outputLabIterator.Scatter(&( LabBuf[b] ), Lanes);
+        outputLabIterator.NextLine();
+        }
+      }
+    }
+}
+
+template< class TInIter, class TOutDistIter, class TOutLabIter, class RealType >
+void doOneDimensionDilateFirstPassLanes(TInIter & inputIterator, TOutDistIter & outputIterator,
+                                        TOutLabIter & outputLabIterator,
+                                        const unsigned LineLength,
+                                        const unsigned direction,
+                                        const int m_MagnitudeSign,
+                                        const bool m_UseImageSpacing,
+                                        const RealType image_scale,
+                                        const RealType Sigma,
+                                        const unsigned Lanes,
+                                        ScratchArena & arena)
+{
+  // lockstep version of doOneDimensionDilateFirstPass. The binary
+  // Sigma/0 lines are written into the block as the labels are read.
+  using LabelType = typename TInIter::PixelType;
+  RealType iscale = 1.0;
+  if ( m_UseImageSpacing )
+    {
+    iscale = image_scale;
+    }
+  const RealType magnitude = ( m_MagnitudeSign * iscale * iscale ) / ( 2.0 );
+
+  ScratchScope              scope(arena);
+  ScratchBuffer< RealType >  LineBuf(arena, Lanes * LineLength);
+  ScratchBuffer< RealType >  tmpLineBuf(arena, Lanes * LineLength);
+  ScratchBuffer< LabelType > LabBuf(arena, Lanes * LineLength);
+  ScratchBuffer< LabelType > newLabBuf(arena, Lanes * LineLength);
+  ScratchBuffer< RealType >  Parabola(arena, LineLength);
+  FillParabola(&( Parabola[0] ), LineLength, magnitude);
+
+  inputIterator.SetDirection(direction);
+  outputIterator.SetDirection(direction);
+  outputLabIterator.SetDirection(direction);
+
+  inputIterator.GoToBegin();
+  outputIterator.GoToBegin();
+  outputLabIterator.GoToBegin();
+
+  while ( !inputIterator.IsAtEnd() && !outputIterator.IsAtEnd() )
+    {
+    unsigned BlockLines = 0;
+    while ( BlockLines < Lanes && !inputIterator.IsAtEnd() )
+      {
+      inputIterator.Gather(&( LabBuf[BlockLines] ), Lanes);
+      for ( unsigned i = 0; i < LineLength; i++ )
+        {
+        LineBuf[i * Lanes + BlockLines] = LabBuf[i * Lanes + BlockLines] ? Sigma : 0;
+        }
+      inputIterator.NextLine();
+      ++BlockLines;
+      }
+
+    RunLanes< DilateFirstPassLanesKernel< RealType, LabelType > >(Lanes, &( LineBuf[0] ), &( tmpLineBuf[0] ),
+                                                                  static_cast< const LabelType * >( &( LabBuf[0] ) ),
+                                                                  &( newLabBuf[0] ),
+                                                                  static_cast< int >( LineLength ),
+                                                                  static_cast< const RealType * >( &( Parabola[0] ) ));
+
+    for ( unsigned b = 0; b < BlockLines; b++ )
+      {
+      outputIterator.Scatter(&( LineBuf[b] ), Lanes);
+      outputLabIterator.Scatter(&( newLabBuf[b] ), Lanes);
+      outputIterator.NextLine();
+      outputLabIterator.NextLine();
+      }
+    }
+}
+
+template< class TInIter, class TDistIter, class TOutLabIter, class TOutDistIter, class RealType >
+void doOneDimensionErodeLanes(TInIter & inputIterator, TDistIter & inputDistIterator,
+                              TOutDistIter & outputDistIterator, TOutLabIter & outputLabIterator,
+                              const unsigned LineLength,
+                              const unsigned direction,
+                              const int m_MagnitudeSign,
+                              const bool m_UseImageSpacing,
+                              const RealType m_Extreme,
+                              const RealType image_scale,
+                              const RealType Sigma,
+                              const RealType BaseSigma,
+                              const bool lastpass,
+                              const unsigned Lanes,
+                              ScratchArena & arena)
+{
+  // lockstep version of doOneDimensionErode. A block of Lanes lines is
+  // read, the label runs of the whole block are gathered Lanes at a
+  // time into transposed buffers, eroded together and put back.
+  using LabelType = typename TInIter::PixelType;
+  RealType iscale = 1.0;
+  if ( m_UseImageSpacing )
+    {
+    iscale = image_scale;
+    }
+  const RealType magnitude = ( m_MagnitudeSign * iscale * iscale ) / ( 2.0 * Sigma );
+
+  ScratchScope              scope(arena);
+  ScratchBuffer< RealType >  LineBlock(arena, Lanes * LineLength);
+  ScratchBuffer< LabelType > LabBlock(arena, Lanes * LineLength);
+  ScratchBuffer< RealType >  RunBuf(arena, Lanes * ( LineLength + 2 ));
+  ScratchBuffer< RealType >  tmpRunBuf(arena, Lanes * ( LineLength + 2 ));
+  ScratchBuffer< int >       RunLength(arena, Lanes);
+  ScratchBuffer< RealType >  Parabola(arena, LineLength + 2);
+  FillParabola(&( Parabola[0] ), LineLength + 2, magnitude);
+
+  // line, first, last for each run in the block - there can't be more
+  // runs than pixels
+  struct RunType
+  {
+    unsigned line, first, last;
+  };
+  ScratchBuffer< RunType > Runs(arena, Lanes * LineLength);
+  size_t                   NumRuns = 0;
+
+  inputIterator.SetDirection(direction);
+  outputDistIterator.SetDirection(direction);
+  inputDistIterator.SetDirection(direction);
+  outputLabIterator.SetDirection(direction);
+
+  inputIterator.GoToBegin();
+  outputDistIterator.GoToBegin();
+  inputDistIterator.GoToBegin();
+  outputLabIterator.GoToBegin();
+
+  while ( !inputIterator.IsAtEnd() && !outputDistIterator.IsAtEnd() )
+    {
+    // read a block of lines
+    unsigned BlockLines = 0;
+    NumRuns = 0;
+    while ( BlockLines < Lanes && !inputIterator.IsAtEnd() )
+      {
+      RealType * LineBuf = &( LineBlock[BlockLines * LineLength] );
+      LabelType *LabBuf = &( LabBlock[BlockLines * LineLength] );
+      inputDistIterator.Gather(LineBuf);
+      inputIterator.Gather(LabBuf);
+      for ( unsigned idx = 0; idx < LineLength; idx++ )
+        {
+        LabelType val = LabBuf[idx];
+        if ( val != 0 )
+          {
+          unsigned idxend = idx;
+          for (; idxend < LineLength; idxend++ )
+            {
+            if ( val != LabBuf[idxend] )
+              {
+              break;
+              }
+            }
+          RunType run = { BlockLines, idx, idxend - 1 };
+          Runs[NumRuns++] = run;
+          idx = idxend - 1;
+          }
+        }
+      inputIterator.NextLine();
+      inputDistIterator.NextLine();
+      ++BlockLines;
+      }
+    // the kernel runs as long as the longest run of its lanes, so
+    // runs of similar length go together
+    std::sort( &( Runs[0] ), &( Runs[0] ) + NumRuns,
+               [](const RunType & a, const RunType & b) { return a.last - a.first < b.last - b.first; } );
+
+    // erode the runs, Lanes at a time. Each run is padded with the
+    // values at either end, as in doOneDimensionErode
+    for ( size_t R0 = 0; R0 < NumRuns; R0 += Lanes )
+      {
+      for ( unsigned l = 0; l < Lanes; l++ )
+        {
+        RunLength[l] = 0;
+        if ( R0 + l >= NumRuns )
+          {
+          continue;
+          }
+        const RunType & run = Runs[R0 + l];
+        const unsigned  SLL = run.last - run.first + 1;
+        const RealType *LineBuf = &( LineBlock[run.line * LineLength] );
+        RealType        leftend = 0, rightend = 0;
+        if ( run.first == 0 ) { leftend = BaseSigma; }
+        if ( run.last == LineLength - 1 ) { rightend = BaseSigma; }
+        RunBuf[l] = leftend;
+        for ( unsigned k = 0; k < SLL; k++ )
+          {
+          RunBuf[( k + 1 ) * Lanes + l] = LineBuf[run.first + k];
+          }
+        RunBuf[( SLL + 1 ) * Lanes + l] = rightend;
+        RunLength[l] = SLL + 2;
+        }
+      DoLineLanes< RealType, LabelType, false, false >(Lanes, &( RunBuf[0] ), &( tmpRunBuf[0] ),
+                                                       nullptr, nullptr,
+                                                       &( RunLength[0] ), &( Parabola[0] ), m_Extreme);
+      for ( unsigned l = 0; l < Lanes && R0 + l < NumRuns; l++ )
+        {
+        const RunType & run = Runs[R0 + l];
+        RealType *      LineBuf = &( LineBlock[run.line * LineLength] );
+        for ( unsigned k = 0; k < RunLength[l] - 2u; k++ )
+          {
+          LineBuf[run.first + k] = RunBuf[( k + 1 ) * Lanes + l];
+          }
+        }
+      }
+
+    // write the block back
+    for ( unsigned b = 0; b < BlockLines; b++ )
+      {
+      const RealType *LineBuf = &( LineBlock[b * LineLength] );
+      LabelType *     LabBuf = &( LabBlock[b * LineLength] );
+      outputDistIterator.Scatter(LineBuf);
+      if ( lastpass )
+        {
+        for ( unsigned j = 0; j < LineLength; j++ )
+          {
+          if ( LineBuf[j] != BaseSigma )
+            {
+            LabBuf[j] = 0;
+            }
+          }
+        outputLabIterator.Scatter(LabBuf);
+        outputLabIterator.NextLine();
+        }
+      outputDistIterator.NextLine();
+      }
+    }
+}
+
+template< class TInIter, class TDistIter, class TOutLabIter, class TOutDistIter, class RealType >
+void doOneDimensionDilateLanes(TInIter & inputIterator, TDistIter & inputDistIterator,
+                               TOutDistIter & outputDistIterator, TOutLabIter & outputLabIterator,
+                               const unsigned LineLength,
+                               const unsigned direction,
+                               const int m_MagnitudeSign,
+                               const bool m_UseImageSpacing,
+                               const RealType m_Extreme,
+                               const RealType image_scale,
+                               const RealType Sigma,
+                               const unsigned Lanes,
+                               ScratchArena & arena)
+{
+  // lockstep version of doOneDimensionDilate. The kernel scans the
+  // widest search window of any of its lanes, and a line's window is
+  // set by how far its peaks reach, so lines are read a group at a
+  // time and sorted by the spread of their values before they are
+  // packed into lanes. Flat lines, which most of the background is,
+  // come through unchanged - each position wins its own tie - and are
+  // left out.
+  using LabelType = typename TInIter::PixelType;
+  RealType iscale = 1.0;
+  if ( m_UseImageSpacing )
+    {
+    iscale = image_scale;
+    }
+  const RealType magnitude = ( m_MagnitudeSign * iscale * iscale ) / ( 2.0 * Sigma );
+  const unsigned GroupLines = 2 * Lanes;
+
+  ScratchScope              scope(arena);
+  ScratchBuffer< RealType >  LineGroup(arena, GroupLines * LineLength);
+  ScratchBuffer< LabelType > LabGroup(arena, GroupLines * LineLength);
+  ScratchBuffer< RealType >  LineBuf(arena, Lanes * LineLength);
+  ScratchBuffer< RealType >  tmpLineBuf(arena, Lanes * LineLength);
+  ScratchBuffer< LabelType > LabBuf(arena, Lanes * LineLength);
+  ScratchBuffer< LabelType > tmpLabBuf(arena, Lanes * LineLength);
+  ScratchBuffer< int >       Lengths(arena, Lanes);
+  ScratchBuffer< unsigned >  Busy(arena, GroupLines);
+  ScratchBuffer< RealType >  Spread(arena, GroupLines);
+  ScratchBuffer< RealType >  Parabola(arena, LineLength);
+  FillParabola(&( Parabola[0] ), LineLength, magnitude);
+
+  inputIterator.SetDirection(direction);
+  inputDistIterator.SetDirection(direction);
+  outputDistIterator.SetDirection(direction);
+  outputLabIterator.SetDirection(direction);
+
+  inputIterator.GoToBegin();
+  inputDistIterator.GoToBegin();
+  outputDistIterator.GoToBegin();
+  outputLabIterator.GoToBegin();
+
+  while ( !inputDistIterator.IsAtEnd() && !outputLabIterator.IsAtEnd() )
+    {
+    unsigned GroupSize = 0;
+    unsigned NumBusy = 0;
+    while ( GroupSize < GroupLines && !inputDistIterator.IsAtEnd() )
+      {
+      RealType *Line = &( LineGroup[GroupSize * LineLength] );
+      inputDistIterator.Gather(Line);
+      inputIterator.Gather( &( LabGroup[GroupSize * LineLength] ) );
+      const std::pair< RealType *, RealType * > range = std::minmax_element(Line, Line + LineLength);
+      Spread[GroupSize] = *range.second - *range.first;
+      if ( Spread[GroupSize] > 0 )
+        {
+        Busy[NumBusy++] = GroupSize;
+        }
+      inputIterator.NextLine();
+      inputDistIterator.NextLine();
+      ++GroupSize;
+      }
+    std::sort( &( Busy[0] ), &( Busy[0] ) + NumBusy,
+               [&](unsigned a, unsigned b) { return Spread[a] < Spread[b]; } );
+
+    for ( unsigned B0 = 0; B0 < NumBusy; B0 += Lanes )
+      {
+      const unsigned BlockLines = std::min(Lanes, NumBusy - B0);
+      for ( unsigned l = 0; l < Lanes; l++ )
+        {
+        Lengths[l] = ( l < BlockLines ) ? LineLength : 0;
+        }
+      for ( unsigned l = 0; l < BlockLines; l++ )
+        {
+        const RealType * Line = &( LineGroup[Busy[B0 + l] * LineLength] );
+        const LabelType *Lab = &( LabGroup[Busy[B0 + l] * LineLength] );
+        for ( unsigned i = 0; i < LineLength; i++ )
+          {
+          LineBuf[i * Lanes + l] = Line[i];
+          LabBuf[i * Lanes + l] = Lab[i];
+          }
+        }
+
+      DoLineLanes< RealType, LabelType, true, true >(Lanes, &( LineBuf[0] ), &( tmpLineBuf[0] ),
+                                                     &( LabBuf[0] ), &( tmpLabBuf[0] ),
+                                                     &( Lengths[0] ), &( Parabola[0] ), m_Extreme);
+
+      for ( unsigned l = 0; l < BlockLines; l++ )
+        {
+        RealType * Line = &( LineGroup[Busy[B0 + l] * LineLength] );
+        LabelType *Lab = &( LabGroup[Busy[B0 + l] * LineLength] );
+        for ( unsigned i = 0; i < LineLength; i++ )
+          {
+          Line[i] = LineBuf[i * Lanes + l];
+          Lab[i] = LabBuf[i * Lanes + l];
+          }
+        }
+      }
+
+    for ( unsigned b = 0; b < GroupSize; b++ )
+      {
+      outputDistIterator.Scatter( &( LineGroup[b * LineLength] ) );
+      outputLabIterator.Scatter( &( LabGroup[b * LineLength] ) );
+      outputLabIterator.NextLine();
+      outputDistIterator.NextLine();
+      }
+    }
+}
+}
+}
+#endif
@@ -0,0 +1,402 @@
+/*=========================================================================
+ *
+ *  Copyright Insight Software Consortium
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+#ifndef itkLabelSetLineAccess_h
+#define itkLabelSetLineAccess_h
+
+#include "itkIntTypes.h"
+#include "itkLabelSetScratchArena.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <type_traits>
+
+#if defined( __GNUC__ )
+#define ITK_LABELSET_PREFETCH(p, rw) __builtin_prefetch( ( p ), ( rw ) )
+#else
+#define ITK_LABELSET_PREFETCH(p, rw)
+#endif
+
+// Access to the lines of an image region along one axis. The start of
+// each line and the stride along it are computed from the buffered
+// region, and whole lines are copied to and from the line buffers
+// with plain loops, instead of a pixel at a time through
+// ImageLinearIteratorWithIndex. Lines are visited in the same order
+// as the linear iterators - the lowest of the other axes fastest -
+// unless another order is given. The buffer may also be laid out with
+// the axes in another order, fastest first, which is how the
+// rotating pass pipeline keeps the next pass's lines contiguous.
+//
+// Lines along the other axes are a row or slice apart, so reading one
+// touches a new cache line at every pixel. With tiles switched on
+// the accessor reads a tile of adjacent lines at once - a short
+// contiguous row from each position along the axis - into a
+// transposed block, and the lines are served from there. Written
+// lines are collected in the same way and stored a tile at a time
+// when the tile is left. The tile runs along the first of the other
+// axes in the line order. An accessor is either read or written, not
+// both, and a reading accessor can pass every line it reads on to a
+// writing one. Only the part of each pixel selected by TField is read
+// or written.
+namespace itk
+{
+namespace LabSet
+{
+// a distance and a label stored side by side, so a dilation pass
+// reads and writes one image instead of two
+template< class TDistance, class TLabel >
+struct DistanceLabelPair
+{
+  TDistance Distance;
+  TLabel    Label;
+};
+
+// the part of each pixel an accessor reads and writes - the whole
+// pixel, or one member of a DistanceLabelPair
+template< class TPixel >
+struct WholePixel
+{
+  using ValueType = TPixel;
+  static const ValueType & Get(const TPixel & p) { return p; }
+  static void Set(TPixel & p, const ValueType & v) { p = v; }
+};
+
+template< class TPixel >
+struct DistanceField
+{
+  using ValueType = decltype( TPixel::Distance );
+  static const ValueType & Get(const TPixel & p) { return p.Distance; }
+  static void Set(TPixel & p, const ValueType & v) { p.Distance = v; }
+};
+
+template< class TPixel >
+struct LabelField
+{
+  using ValueType = decltype( TPixel::Label );
+  static const ValueType & Get(const TPixel & p) { return p.Label; }
+  static void Set(TPixel & p, const ValueType & v) { p.Label = v; }
+};
+
+template< class TImage,
+          class TField = WholePixel< typename std::remove_const< TImage >::type::PixelType > >
+class LineAccessor
+{
+public:
+  using ImageType = typename std::remove_const< TImage >::type;
+  using StoredType = typename ImageType::PixelType;
+  using PixelType = typename TField::ValueType;
+  using RegionType = typename ImageType::RegionType;
+
+  static constexpr unsigned ImageDimension = ImageType::ImageDimension;
+
+  // how far ahead along a strided line to prefetch
+  static constexpr SizeValueType PrefetchDistance = 8;
+
+  LineAccessor(TImage *image, const RegionType & region) :
+    LineAccessor(image, nullptr, nullptr, region)
+  {}
+
+  // the buffer is laid out with the axes in the order given by layout,
+  // fastest first, and lines are visited with the other axes in the
+  // order given by order. Null means the usual order for either.
+  LineAccessor(TImage *image, const unsigned *layout, const unsigned *order,
+               const RegionType & region) :
+    m_Region(region), m_Direction(0), m_Copy(nullptr), m_TileLines(1), m_TileAxis(0), m_Tiled(false),
+    m_Tile(nullptr), m_TileStart(nullptr), m_TileFirst(0), m_TileCount(0), m_TileWritten(0)
+  {
+    const RegionType & buffered = image->GetBufferedRegion();
+
+    OffsetValueType step = 1;
+    for ( unsigned d = 0; d < ImageDimension; d++ )
+      {
+      const unsigned axis = layout ? layout[d] : d;
+      m_Strides[axis] = step;
+      step *= buffered.GetSize()[axis];
+      m_Order[d] = order ? order[d] : d;
+      }
+    m_Origin = const_cast< StoredType * >( image->GetBufferPointer() );
+    for ( unsigned d = 0; d < ImageDimension; d++ )
+      {
+      m_Origin += ( region.GetIndex()[d] - buffered.GetIndex()[d] ) * m_Strides[d];
+      }
+    this->GoToBegin();
+  }
+
+  // contiguous lines are never tiled
+  LineAccessor(TImage *image, const RegionType & region,
+               const unsigned TileLines, ScratchArena & arena) :
+    LineAccessor(image, nullptr, nullptr, region, TileLines, arena)
+  {}
+
+  LineAccessor(TImage *image, const unsigned *layout, const unsigned *order,
+               const RegionType & region, const unsigned TileLines, ScratchArena & arena) :
+    LineAccessor(image, layout, order, region)
+  {
+    if ( TileLines > 1 && ImageDimension > 1 )
+      {
+      SizeValueType LongestLine = 0;
+      for ( unsigned d = 0; d < ImageDimension; d++ )
+        {
+        LongestLine = std::max( LongestLine, m_Region.GetSize()[d] );
+        }
+      m_TileLines = TileLines;
+      m_Tile = arena.Allocate< StoredType >(TileLines * LongestLine);
+      }
+  }
+
+  ~LineAccessor()
+  {
+    this->FlushTile();
+  }
+
+  // every line read is also written to target, which must visit the
+  // same lines in the same order
+  void SetCopyTarget(LineAccessor< ImageType, TField > *target)
+  {
+    m_Copy = target;
+  }
+
+  void SetDirection(const unsigned direction)
+  {
+    m_Direction = direction;
+    if ( m_Copy )
+      {
+      m_Copy->SetDirection(direction);
+      }
+  }
+
+  void GoToBegin()
+  {
+    if ( m_Copy )
+      {
+      m_Copy->GoToBegin();
+      }
+    this->FlushTile();
+    m_Length = m_Region.GetSize()[m_Direction];
+    m_Stride = m_Strides[m_Direction];
+    m_Tiled = ( m_TileLines > 1 && m_Stride != 1 );
+    m_NumberOfLines = ( m_Length > 0 ) ? m_Region.GetNumberOfPixels() / m_Length : 0;
+    m_Line = 0;
+    m_LinePointer = m_Origin;
+    for ( unsigned d = 0; d < ImageDimension; d++ )
+      {
+      m_Position[d] = 0;
+      }
+    m_TileAxis = ( m_Order[0] == m_Direction ) ? m_Order[1 % ImageDimension] : m_Order[0];
+  }
+
+  bool IsAtEnd() const
+  {
+    return m_Line >= m_NumberOfLines;
+  }
+
+  void NextLine()
+  {
+    if ( m_Copy )
+      {
+      m_Copy->NextLine();
+      }
+    ++m_Line;
+    if ( m_TileCount > 0 && m_Line >= m_TileFirst + m_TileCount )
+      {
+      this->FlushTile();
+      }
+    for ( unsigned o = 0; o < ImageDimension; o++ )
+      {
+      const unsigned d = m_Order[o];
+      if ( d == m_Direction )
+        {
+        continue;
+        }
+      m_LinePointer += m_Strides[d];
+      if ( ++m_Position[d] < m_Region.GetSize()[d] )
+        {
+        return;
+        }
+      m_LinePointer -= m_Position[d] * m_Strides[d];
+      m_Position[d] = 0;
+      }
+  }
+
+  SizeValueType GetLineLength() const
+  {
+    return m_Length;
+  }
+
+  // copy the current line to dst[i * dstStride]
+  template< class T >
+  void Gather(T *dst, const std::ptrdiff_t dstStride = 1)
+  {
+    this->GatherLine(dst, dstStride);
+    if ( m_Copy )
+      {
+      m_Copy->Scatter(dst, dstStride);
+      }
+  }
+
+  // copy src[i * srcStride] to the current line
+  template< class T >
+  void Scatter(const T *src, const std::ptrdiff_t srcStride = 1)
+  {
+    StoredType *          dst = m_LinePointer;
+    const OffsetValueType stride = m_Stride;
+
+    if ( m_Tiled )
+      {
+      if ( m_TileCount == 0 )
+        {
+        this->StartTile();
+        }
+      dst = m_Tile + ( m_Line - m_TileFirst ) * m_Length;
+      for ( SizeValueType i = 0; i < m_Length; i++ )
+        {
+        TField::Set( dst[i], static_cast< PixelType >( src[i * srcStride] ) );
+        }
+      m_TileWritten = m_Line - m_TileFirst + 1;
+      return;
+      }
+    if ( stride == 1 )
+      {
+      for ( SizeValueType i = 0; i < m_Length; i++ )
+        {
+        TField::Set( dst[i], static_cast< PixelType >( src[i * srcStride] ) );
+        }
+      return;
+      }
+    SizeValueType i = 0;
+    for (; i + PrefetchDistance < m_Length; i++ )
+      {
+      ITK_LABELSET_PREFETCH(dst + ( i + PrefetchDistance ) * stride, 1);
+      TField::Set( dst[i * stride], static_cast< PixelType >( src[i * srcStride] ) );
+      }
+    for (; i < m_Length; i++ )
+      {
+      TField::Set( dst[i * stride], static_cast< PixelType >( src[i * srcStride] ) );
+      }
+  }
+
+private:
+  template< class T >
+  void GatherLine(T *dst, const std::ptrdiff_t dstStride)
+  {
+    const StoredType *    src = m_LinePointer;
+    const OffsetValueType stride = m_Stride;
+
+    if ( m_Tiled )
+      {
+      if ( m_TileCount == 0 )
+        {
+        this->StartTile();
+        this->LoadTile();
+        }
+      src = m_Tile + ( m_Line - m_TileFirst ) * m_Length;
+      for ( SizeValueType i = 0; i < m_Length; i++ )
+        {
+        dst[i * dstStride] = static_cast< T >( TField::Get(src[i]) );
+        }
+      return;
+      }
+    if ( stride == 1 )
+      {
+      for ( SizeValueType i = 0; i < m_Length; i++ )
+        {
+        dst[i * dstStride] = static_cast< T >( TField::Get(src[i]) );
+        }
+      return;
+      }
+    SizeValueType i = 0;
+    for (; i + PrefetchDistance < m_Length; i++ )
+      {
+      ITK_LABELSET_PREFETCH(src + ( i + PrefetchDistance ) * stride, 0);
+      dst[i * dstStride] = static_cast< T >( TField::Get(src[i * stride]) );
+      }
+    for (; i < m_Length; i++ )
+      {
+      dst[i * dstStride] = static_cast< T >( TField::Get(src[i * stride]) );
+      }
+  }
+
+  // the tile starts at the current line and runs along the tile axis
+  // to the end of the region
+  void StartTile()
+  {
+    m_TileFirst = m_Line;
+    m_TileCount = std::min< SizeValueType >( m_TileLines, m_Region.GetSize()[m_TileAxis] - m_Position[m_TileAxis] );
+    m_TileCount = std::min(m_TileCount, m_NumberOfLines - m_Line);
+    m_TileStart = m_LinePointer;
+    m_TileWritten = 0;
+  }
+
+  void LoadTile()
+  {
+    const SizeValueType   count = m_TileCount;
+    const OffsetValueType step = m_Strides[m_TileAxis];
+
+    for ( SizeValueType i = 0; i < m_Length; i++ )
+      {
+      const StoredType *src = m_TileStart + i * m_Stride;
+      for ( SizeValueType k = 0; k < count; k++ )
+        {
+        m_Tile[k * m_Length + i] = src[k * step];
+        }
+      }
+  }
+
+  void FlushTile()
+  {
+    const SizeValueType   count = m_TileWritten;
+    const OffsetValueType step = m_Strides[m_TileAxis];
+
+    for ( SizeValueType i = 0; i < m_Length && count > 0; i++ )
+      {
+      StoredType *dst = m_TileStart + i * m_Stride;
+      for ( SizeValueType k = 0; k < count; k++ )
+        {
+        TField::Set( dst[k * step], TField::Get(m_Tile[k * m_Length + i]) );
+        }
+      }
+    m_TileCount = 0;
+    m_TileWritten = 0;
+  }
+
+  RegionType      m_Region;
+  StoredType *    m_Origin;
+  OffsetValueType m_Strides[ImageDimension];
+  unsigned        m_Order[ImageDimension];
+  unsigned        m_Direction;
+
+  LineAccessor< ImageType, TField > *m_Copy;
+
+  StoredType *    m_LinePointer;
+  OffsetValueType m_Stride;
+  SizeValueType   m_Length;
+  SizeValueType   m_NumberOfLines;
+  SizeValueType   m_Line;
+  SizeValueType   m_Position[ImageDimension];
+
+  unsigned      m_TileLines;
+  unsigned      m_TileAxis;
+  bool          m_Tiled;
+  StoredType *  m_Tile;
+  StoredType *  m_TileStart;
+  SizeValueType m_TileFirst;
+  SizeValueType m_TileCount;
+  SizeValueType m_TileWritten;
+};
+}
+}
+#endif
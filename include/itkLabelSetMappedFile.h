@@ -0,0 +1,201 @@
+/*=========================================================================
+ *
+ *  Copyright Insight Software Consortium
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+#ifndef itkLabelSetMappedFile_h
+#define itkLabelSetMappedFile_h
+
+#include "itkImportImageContainer.h"
+
+#include <cstddef>
+#include <cstdlib>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#if defined( __unix__ ) || defined( __APPLE__ )
+#include <sys/mman.h>
+#include <unistd.h>
+#define ITK_LABELSET_MAPPED_FILES 1
+#endif
+
+// Buffers held in memory mapped temporary files, so the kernel can
+// write their pages out to disk and read them back as the passes
+// reach them, instead of the process needing them all in memory. The
+// file is unlinked as soon as it is made, so nothing is left behind
+// when the process ends. Only where there is mmap.
+namespace itk
+{
+namespace LabSet
+{
+class MappedFile
+{
+public:
+  MappedFile() :
+    m_Buffer(nullptr), m_Bytes(0)
+  {}
+
+  ~MappedFile()
+  {
+#if defined( ITK_LABELSET_MAPPED_FILES )
+    if ( m_Buffer )
+      {
+      munmap(m_Buffer, m_Bytes);
+      }
+#endif
+  }
+
+  MappedFile(const MappedFile &) = delete;
+  MappedFile & operator=(const MappedFile &) = delete;
+
+  static bool IsSupported()
+  {
+#if defined( ITK_LABELSET_MAPPED_FILES )
+    return true;
+#else
+    return false;
+#endif
+  }
+
+  // the directory for the files when none is given
+  static std::string GetDefaultDirectory()
+  {
+    const char *tmp = std::getenv("TMPDIR");
+    return ( tmp && *tmp ) ? tmp : "/tmp";
+  }
+
+  // a zero filled buffer of bytes in a new file in directory, false
+  // if the file can't be made or mapped
+  bool Map(const std::string & directory, const std::size_t bytes)
+  {
+#if defined( ITK_LABELSET_MAPPED_FILES )
+    if ( m_Buffer || bytes == 0 )
+      {
+      return false;
+      }
+    const std::string  name = ( directory.empty() ? GetDefaultDirectory() : directory ) + "/LabelSetXXXXXX";
+    std::vector< char > path( name.begin(), name.end() );
+    path.push_back('\0');
+    const int fd = mkstemp( path.data() );
+    if ( fd < 0 )
+      {
+      return false;
+      }
+    unlink( path.data() );
+    void *buffer = MAP_FAILED;
+    if ( ftruncate(fd, static_cast< off_t >( bytes )) == 0 )
+      {
+      buffer = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+      }
+    // the mapping keeps the file open
+    close(fd);
+    if ( buffer == MAP_FAILED )
+      {
+      return false;
+      }
+    m_Buffer = buffer;
+    m_Bytes = bytes;
+    return true;
+#else
+    (void)directory;
+    (void)bytes;
+    return false;
+#endif
+  }
+
+  void * GetBuffer() const
+  {
+    return m_Buffer;
+  }
+
+private:
+  void *      m_Buffer;
+  std::size_t m_Bytes;
+};
+
+// A pixel container that allocates in mapped files, for images of
+// plain pixel types, which the zero filled files initialize.
+template< typename TElementIdentifier, typename TElement >
+class MappedImageContainer:public ImportImageContainer< TElementIdentifier, TElement >
+{
+public:
+  ITK_DISALLOW_COPY_AND_ASSIGN(MappedImageContainer);
+
+  using Self = MappedImageContainer;
+  using Superclass = ImportImageContainer< TElementIdentifier, TElement >;
+  using Pointer = SmartPointer< Self >;
+  using ConstPointer = SmartPointer< const Self >;
+  using ElementIdentifier = TElementIdentifier;
+  using Element = TElement;
+
+  itkNewMacro(Self);
+  itkTypeMacro(MappedImageContainer, ImportImageContainer);
+
+  // the directory for the files, the default one if empty
+  void SetDirectory(const std::string & directory)
+  {
+    m_Directory = directory;
+  }
+
+  const std::string & GetDirectory() const
+  {
+    return m_Directory;
+  }
+
+protected:
+  MappedImageContainer() = default;
+
+  ~MappedImageContainer() override
+  {
+    // the superclass would delete the buffer
+    this->DeallocateManagedMemory();
+  }
+
+  TElement * AllocateElements(ElementIdentifier size, bool) const override
+  {
+    std::unique_ptr< MappedFile > file(new MappedFile);
+    if ( !file->Map( m_Directory, static_cast< std::size_t >( size ) * sizeof( TElement ) ) )
+      {
+      throw MemoryAllocationError(__FILE__, __LINE__,
+                                  "Failed to map a temporary file for image memory.", ITK_LOCATION);
+      }
+    auto *data = static_cast< TElement * >( file->GetBuffer() );
+    m_Files[data] = std::move(file);
+    return data;
+  }
+
+  void DeallocateManagedMemory() override
+  {
+    auto file = m_Files.find( this->GetImportPointer() );
+    if ( file == m_Files.end() )
+      {
+      Superclass::DeallocateManagedMemory();
+      return;
+      }
+    // unmapped here rather than deleted
+    this->SetContainerManageMemory(false);
+    Superclass::DeallocateManagedMemory();
+    m_Files.erase(file);
+  }
+
+private:
+  std::string                                               m_Directory;
+  mutable std::map< TElement *, std::unique_ptr< MappedFile > > m_Files;
+};
+}
+}
+#endif
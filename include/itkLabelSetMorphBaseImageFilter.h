@@ -19,7 +19,15 @@
 #define itkLabelSetMorphBaseImageFilter_h
 
 #include "itkNumericTraits.h"
-#include "itkImageToImageFilter.h"
+#include "itkInPlaceImageFilter.h"
+#include "itkLabelSetScratchArena.h"
+#include "itkLabelSetLineAccess.h"
+#include "itkLabelSetBlockScheduler.h"
+#include "itkLabelSetThreadPlacement.h"
+#include "itkLabelSetHugePages.h"
+#include "itkLabelSetMappedFile.h"
+
+#include <type_traits>
 
 namespace itk
 {
@@ -35,6 +43,20 @@ using RegionIndexType = unsigned int;
  *
  * This filter is threaded. This class handles the threading for subclasses.
  *
+ * The filter can run in place when the input and output types are the
+ * same - see InPlaceImageFilter. It is off by default. The internal
+ * distance images are kept between updates and reused while the
+ * region doesn't change, unless the memory policy says otherwise.
+ *
+ * Only the output requested region is produced. It needs as much of
+ * the input as lies within the reach of the radius of it, so the
+ * filter can be streamed, with StreamingImageFilter for instance, and
+ * holds the distance images for one piece at a time.
+ * A viewer showing a slice or a box of the result sets the output's
+ * requested region to it before updating, and only it and the planes
+ * within reach are processed, so the time taken follows the size of
+ * the box rather than the image.
+ *
  * \sa itkLabelSetDilateImageFilter itkLabelSetErodeImageFilter
  *
  * \ingroup LabelErodeDilate
@@ -45,14 +67,14 @@ using RegionIndexType = unsigned int;
 template< typename TInputImage, bool doDilate,
           typename TOutputImage = TInputImage >
 class ITK_EXPORT LabelSetMorphBaseImageFilter:
-  public ImageToImageFilter< TInputImage, TOutputImage >
+  public InPlaceImageFilter< TInputImage, TOutputImage >
 {
 public:
   ITK_DISALLOW_COPY_AND_ASSIGN(LabelSetMorphBaseImageFilter);
 
   /** Standard class type alias. */
   using Self = LabelSetMorphBaseImageFilter;
-  using Superclass = ImageToImageFilter< TInputImage, TOutputImage >;
+  using Superclass = InPlaceImageFilter< TInputImage, TOutputImage >;
   using Pointer = SmartPointer< Self >;
   using ConstPointer = SmartPointer< const Self >;
 
@@ -60,7 +82,7 @@ public:
   itkNewMacro(Self);
 
   /** Runtime information support. */
-  itkTypeMacro(LabelSetMorphBaseImageFilter, ImageToImageFilter);
+  itkTypeMacro(LabelSetMorphBaseImageFilter, InPlaceImageFilter);
 
   /** Pixel Type of the input image */
   using InputImageType = TInputImage;
@@ -99,6 +121,245 @@ public:
   itkGetConstReferenceMacro(UseImageSpacing, bool);
   itkBooleanMacro(UseImageSpacing);
 
+  /**
+   * Set/Get whether the per-line parabolic operations use the linear
+   * time envelope algorithm instead of the contact point
+   * algorithm. The contact point search cost grows with the radius,
+   * the envelope doesn't. Distances agree to within rounding, and
+   * where two parabolas are level to within it the label may come
+   * from either - default is false
+   */
+  itkSetMacro(UseEnvelopeAlgorithm, bool);
+  itkGetConstReferenceMacro(UseEnvelopeAlgorithm, bool);
+  itkBooleanMacro(UseEnvelopeAlgorithm);
+
+  /**
+   * Set/Get whether the float passes run blocks of lines in lockstep
+   * with AVX2 or AVX-512, if the cpu has them. Only the first pass and
+   * the contact point passes are vectorized - the later passes stay
+   * scalar with the envelope algorithm, as do the integer passes -
+   * default is false
+   */
+  itkSetMacro(UseVectorization, bool);
+  itkGetConstReferenceMacro(UseVectorization, bool);
+  itkBooleanMacro(UseVectorization);
+
+  /**
+   * Set/Get whether a radius in voxels is handled with exact integer
+   * arithmetic. The distance image holds weighted squared distances
+   * in 32 bit integers and a voxel offset d belongs to the
+   * structuring element when sum_i (d_i / r_i)^2 <= 1, so the results
+   * don't depend on rounding and the floating point safety margin
+   * isn't applied. A radius of 0 means no extent along that
+   * axis. Unequal radii must be whole numbers. Has no effect when
+   * UseImageSpacing is on - default is false
+   */
+  itkSetMacro(UseIntegerArithmetic, bool);
+  itkGetConstReferenceMacro(UseIntegerArithmetic, bool);
+  itkBooleanMacro(UseIntegerArithmetic);
+
+  /**
+   * Set/Get whether the integer passes keep the distance image in 16
+   * bits instead of 32. Only applies with UseIntegerArithmetic and a
+   * radius in voxels - the float distance image is never compacted -
+   * and needs the weighted squared distance to fit, an isotropic
+   * radius below 256 voxels for instance, falling back to 32 bits
+   * with a warning - default is false
+   */
+  itkSetMacro(UseCompactDistanceImage, bool);
+  itkGetConstReferenceMacro(UseCompactDistanceImage, bool);
+  itkBooleanMacro(UseCompactDistanceImage);
+
+  /**
+   * Set/Get the number of strided lines along each axis copied
+   * together through a transposed tile. 1 switches tiling off -
+   * default is 16, a cache line of float distances
+   */
+  using TileLinesType = FixedArray< unsigned, TInputImage::ImageDimension >;
+  itkSetMacro(TileLines, TileLinesType);
+  itkGetConstReferenceMacro(TileLines, TileLinesType);
+
+  /**
+   * Set/Get whether each pass writes its results with the next pass's
+   * axis fastest, so every pass reads contiguous lines. Holds a second
+   * copy of the distance and label images - default is false
+   */
+  itkSetMacro(UseRotatedLayout, bool);
+  itkGetConstReferenceMacro(UseRotatedLayout, bool);
+  itkBooleanMacro(UseRotatedLayout);
+
+  /**
+   * Set/Get whether dilation keeps distances and labels in one image of
+   * pairs between passes. Erosion, the integer passes and the rotated
+   * layout can't, and warn that they keep them apart - default is false
+   */
+  itkSetMacro(UseInterleavedBuffer, bool);
+  itkGetConstReferenceMacro(UseInterleavedBuffer, bool);
+  itkBooleanMacro(UseInterleavedBuffer);
+
+  /** Get whether the last update kept distances and labels interleaved. */
+  itkGetConstMacro(InterleavedPasses, bool);
+
+  /**
+   * What happens to the internal distance images after an update:
+   * kept for the next one, released, or never allocated at full size
+   * by processing slabs of planes along the last axis. Slabs aren't
+   * used in place - default is KeepDistanceImage
+   */
+  enum MemoryPolicyType {
+    KeepDistanceImage = 0,
+    ReleaseDistanceImage,
+    SlabDistanceImage
+  };
+  itkSetMacro(MemoryPolicy, MemoryPolicyType);
+  itkGetConstMacro(MemoryPolicy, MemoryPolicyType);
+
+  /** Set/Get the planes produced by each slab with SlabDistanceImage - default is 32 */
+  itkSetClampMacro(SlabThickness, SizeValueType, 1, NumericTraits< SizeValueType >::max());
+  itkGetConstMacro(SlabThickness, SizeValueType);
+
+  /**
+   * Set/Get the bytes the slab buffers may take. If it isn't 0 it
+   * sets the slab thickness instead of SlabThickness - default is 0
+   */
+  itkSetMacro(MemoryBudget, SizeValueType);
+  itkGetConstMacro(MemoryBudget, SizeValueType);
+
+  /**
+   * Set/Get whether the internal images are held in memory mapped
+   * temporary files, so they needn't fit in memory. Needs mmap -
+   * default is false
+   */
+  itkSetMacro(UseMappedFiles, bool);
+  itkGetConstReferenceMacro(UseMappedFiles, bool);
+  itkBooleanMacro(UseMappedFiles);
+
+  /** Set/Get the directory for the mapped files - default is TMPDIR, or /tmp if it isn't set. */
+  itkSetStringMacro(TemporaryDirectory);
+  itkGetStringMacro(TemporaryDirectory);
+
+  /** Get the most bytes held in internal buffers during the last update, input and output aside. */
+  itkGetConstMacro(PeakMemoryBytes, SizeValueType);
+
+  /**
+   * How the passes are shared out between the work units:
+   * StaticPasses gives each one equal piece. StealingPasses gives
+   * each a share of blocks of lines, and it steals from the others'
+   * when its own runs out. WavefrontPasses runs the passes split on
+   * the same axis one after another on each block of planes, with no
+   * barrier between them, and steals for the rest - it is just
+   * StealingPasses in 2D or with a single plane. NativePasses goes
+   * through the multithreader's own parallel for. NarrowBandPasses
+   * only runs the passes on 16 voxel blocks within reach of a label
+   * boundary, stealing them - default is StaticPasses
+   */
+  enum PassSchedulingType {
+    StaticPasses = 0,
+    StealingPasses,
+    WavefrontPasses,
+    NativePasses,
+    NarrowBandPasses
+  };
+  itkSetMacro(PassScheduling, PassSchedulingType);
+  itkGetConstMacro(PassScheduling, PassSchedulingType);
+
+  /**
+   * Set/Get whether the shares of stolen blocks of lines are equal in
+   * estimated cost, label voxels counting double, rather than in
+   * blocks. Used by StealingPasses and the passes after the wavefront -
+   * default is false
+   */
+  itkSetMacro(UseCostEstimate, bool);
+  itkGetConstReferenceMacro(UseCostEstimate, bool);
+  itkBooleanMacro(UseCostEstimate);
+
+  /**
+   * Set/Get the fewest lines in a block given to ParallelizeArray with
+   * NativePasses. 0 splits by region instead - default is 0
+   */
+  itkSetMacro(GrainSize, SizeValueType);
+  itkGetConstMacro(GrainSize, SizeValueType);
+
+  /**
+   * Set/Get whether new buffers are first written by the work unit
+   * that processes them, so their pages are placed on its socket. The
+   * output isn't touched in place - default is false
+   */
+  itkSetMacro(UseFirstTouch, bool);
+  itkGetConstReferenceMacro(UseFirstTouch, bool);
+  itkBooleanMacro(UseFirstTouch);
+
+  /**
+   * Set/Get whether work unit w is pinned to the w-th allowed cpu
+   * while it runs. Linux only, and not used with NativePasses -
+   * default is false
+   */
+  itkSetMacro(UseThreadPinning, bool);
+  itkGetConstReferenceMacro(UseThreadPinning, bool);
+  itkBooleanMacro(UseThreadPinning);
+
+  /**
+   * Set/Get whether the internal images are advised to use transparent
+   * huge pages. Linux only, see GetNumberOfHugePageBuffers - default is
+   * false
+   */
+  itkSetMacro(UseHugePages, bool);
+  itkGetConstReferenceMacro(UseHugePages, bool);
+  itkBooleanMacro(UseHugePages);
+
+  /** Get the number of buffers the kernel agreed to back with huge pages during the last update. */
+  itkGetConstMacro(NumberOfHugePageBuffers, SizeValueType);
+
+  /**
+   * Set/Get whether the passes only cover the bounding box of the
+   * labels, grown by their reach. The input is scanned for it first -
+   * default is false
+   */
+  itkSetMacro(UseBoundingBox, bool);
+  itkGetConstReferenceMacro(UseBoundingBox, bool);
+  itkBooleanMacro(UseBoundingBox);
+
+  /** Get the number of voxels in the regions the passes ran over during the last update, slabs counted separately. */
+  itkGetConstMacro(NumberOfPassVoxels, SizeValueType);
+
+  /** Get the number of voxels in the active blocks of the narrow band during the last update. */
+  itkGetConstMacro(NumberOfBandVoxels, SizeValueType);
+
+  /**
+   * Set/Get whether the last output is kept so an update after
+   * AddDirtyRegion only recomputes around the edits. Holds a copy of
+   * the output, and isn't used in place, with the bounding box or
+   * without KeepDistanceImage - default is false
+   */
+  itkSetMacro(UseIncrementalUpdate, bool);
+  itkGetConstReferenceMacro(UseIncrementalUpdate, bool);
+  itkBooleanMacro(UseIncrementalUpdate);
+
+  /**
+   * Mark a region of the input as edited since the last update. With
+   * UseIncrementalUpdate, and nothing else changed, the next update
+   * only recomputes within reach of the marks, which it clears.
+   */
+  void AddDirtyRegion(const OutputImageRegionType & region);
+
+  /** Mark one edited voxel, for a list of them. See AddDirtyRegion. */
+  void AddDirtyIndex(const OutputIndexType & index);
+
+  /** Get whether the last update only recomputed around the marked regions. */
+  itkGetConstMacro(UpdatedIncrementally, bool);
+
+  /** Get the number of times a work unit stole blocks during the last update. */
+  itkGetConstMacro(NumberOfSteals, SizeValueType);
+
+  /**
+   * Get the number of heap allocations made for line buffers during
+   * the last update - one per arena unless one had to grow.
+   */
+  SizeValueType GetNumberOfScratchAllocations() const
+  {
+    return m_ScratchPool.GetNumberOfAllocations();
+  }
+
   /** Image dimension. */
   static constexpr unsigned int ImageDimension = TInputImage::ImageDimension;
   static constexpr unsigned int OutputImageDimension = TOutputImage::ImageDimension;
@@ -121,22 +382,292 @@ protected:
 
   void GenerateData(void) override;
 
-  // Override since the filter produces the entire dataset.
-  void EnlargeOutputRequestedRegion(DataObject *output) override;
+  // The rotating layout. A layout lists the axes fastest first, and
+  // buffer -1 is the image itself, in the usual layout. Pass k reads
+  // rotated buffer (k - 1) % 2 and writes buffer k % 2, and lines are
+  // visited in the order of the written layout. Erosion keeps its
+  // own copy of the input labels.
+  using LayoutType = FixedArray< unsigned, TInputImage::ImageDimension >;
+  using LabelImageType = typename std::conditional< doDilate, TOutputImage, TInputImage >::type;
+
+  // What a pass along one dimension does. They are all set up before
+  // the first runs, so work units can be on different passes.
+  struct PassType
+  {
+    unsigned   Dimension;
+    // an earlier pass has initialized the distances
+    bool       FirstPassDone;
+    // no pass after this one does any work
+    bool       LastPass;
+    int        ReadBuffer;
+    int        WriteBuffer;
+    LayoutType ReadLayout;
+    LayoutType WriteLayout;
+  };
+
+  // the step along axis that pieces of region are split at for pass
+  SizeValueType GetSplitGranule(unsigned axis, const OutputImageRegionType & region, const PassType & pass) const;
+
+  // the axes region is split on, with their granules and the number
+  // of granules, outermost first. Returns the number of axes.
+  unsigned GetSplitAxes(const OutputImageRegionType & region, unsigned axis[2], SizeValueType granule[2],
+                        SizeValueType granules[2]) const;
+
+  // work stealing - the blocks of the current pass and their
+  // estimated costs
+  SizeValueType ComputeBlocks(SizeValueType MinimumLines);
+  void ScheduleBlocks();
+  OutputImageRegionType GetBlock(SizeValueType block) const;
+  void ComputeLabelProfile(const OutputImageRegionType & region);
+
+  static ITK_THREAD_RETURN_FUNCTION_CALL_CONVENTION StealingThreaderCallback(void *arg);
+
+  // the wavefront - the passes in [first, last] run one after another
+  // on each block
+  void ScheduleWavefront(unsigned first, unsigned last);
+  static ITK_THREAD_RETURN_FUNCTION_CALL_CONVENTION WavefrontThreaderCallback(void *arg);
+
+  unsigned m_WavefrontFirst;
+  unsigned m_WavefrontLast;
+
+  // the first touch of the new buffers, split as the pass along
+  // dimension will be, and the usual callback with the thread pinned
+  void FirstTouch(unsigned dimension);
+  void TouchBuffers(const OutputImageRegionType & region);
+  static ITK_THREAD_RETURN_FUNCTION_CALL_CONVENTION FirstTouchThreaderCallback(void *arg);
+  static ITK_THREAD_RETURN_FUNCTION_CALL_CONVENTION PinnedThreaderCallback(void *arg);
+
+  template< typename TImage >
+  static void TouchRegion(TImage *image, const OutputImageRegionType & region);
+
+  bool m_UseFirstTouch;
+  bool m_UseThreadPinning;
+  bool m_TouchBlocks;
+  // the output is touched, and the buffers allocated this update
+  bool m_TouchOutput;
+  bool m_NewDistance;
+  bool m_NewRotated;
+  bool m_NewSlabOutput;
+
+  // transparent huge pages for the buffers allocated this update
+  void AdviseHugePages();
+
+  template< typename TImage >
+  void AdviseHugePages(TImage *image);
+
+  bool          m_UseBoundingBox;
+  SizeValueType m_NumberOfPassVoxels;
+  SizeValueType m_NumberOfBandVoxels;
+  bool          m_UseHugePages;
+  SizeValueType m_NumberOfHugePageBuffers;
+
+  // The narrow band. The blocks of region, fastest first along the
+  // first axis, those that are active, and the stretches of active
+  // blocks along the current pass's lines, which the work units take.
+  static constexpr SizeValueType BandBlockSize = 16;
+
+  void ComputeNarrowBand(const OutputImageRegionType & region);
+  void ScheduleBand(unsigned dimension);
+  void CopyOutsideBand();
+  OutputImageRegionType GetBandBlock(SizeValueType block) const;
+  static ITK_THREAD_RETURN_FUNCTION_CALL_CONVENTION BandThreaderCallback(void *arg);
+
+  OutputSizeType                       m_BandBlocks;
+  std::vector< unsigned char >         m_ActiveBlocks;
+  std::vector< OutputImageRegionType > m_BandRegions;
+
+  // the pass along dimension through the multithreader's parallel for
+  void ParallelizePass(unsigned dimension);
+
+  // runs the passes over region, which is the output requested
+  // region or a slab of it
+  void ProcessRegion(const OutputImageRegionType & region);
+
+  // The input needed for the output requested region is that region
+  // grown by the planes that can change its results.
+  void GenerateInputRequestedRegion() override;
+
+  // the output requested region grown by the halo on every axis,
+  // within the input
+  OutputImageRegionType GetPaddedRegion(const OutputImageRegionType & region) const;
+
+  // the scales and weights of the passes, from the radius
+  void ComputeScales();
 
   bool m_UseImageSpacing;
+  bool m_UseEnvelopeAlgorithm;
+  bool m_UseVectorization;
+  bool m_UseIntegerArithmetic;
+  bool m_UseCompactDistanceImage;
+  bool m_UseRotatedLayout;
+  bool m_UseInterleavedBuffer;
+
+  MemoryPolicyType m_MemoryPolicy;
+  SizeValueType    m_SlabThickness;
+  SizeValueType    m_PeakMemoryBytes;
+  SizeValueType    m_MemoryBudget;
+
+  bool        m_UseMappedFiles;
+  bool        m_MapBuffers;
+  std::string m_TemporaryDirectory;
+
+  // bytes of internal buffers for each pixel of a region, and the
+  // slab thickness that fits the budget
+  SizeValueType GetBytesPerPixel() const;
+  SizeValueType GetBudgetThickness(const OutputImageRegionType & region, SizeValueType halo) const;
+
+  PassSchedulingType           m_PassScheduling;
+  // what the region being processed gets - the wavefront falls back
+  // to stealing where there is no wavefront
+  PassSchedulingType           m_RegionScheduling;
+  SizeValueType                m_GrainSize;
+  bool                         m_UseCostEstimate;
+  SizeValueType                m_NumberOfSteals;
+  LabSet::BlockScheduler       m_Scheduler;
+  unsigned                     m_NumberOfBlockAxes;
+  unsigned                     m_BlockAxis[2];
+  SizeValueType                m_BlockGranule[2];
+  SizeValueType                m_BlockCount[2];
+  std::vector< SizeValueType > m_LabelProfile[TInputImage::ImageDimension];
+
   void PrintSelf(std::ostream & os, Indent indent) const override;
 
   RadiusType m_Radius;
   RadiusType m_Scale;
+  // before the scales after the first are divided by it
+  RadiusType m_UnnormalizedScale;
   using DistanceImageType = typename itk::Image< RealType, TInputImage::ImageDimension >;
   RealType m_Extreme;
 
   typename DistanceImageType::Pointer m_DistanceImage;
 
-  int  m_MagnitudeSign;
-  int  m_CurrentDimension;
-  bool m_FirstPassDone;
+  // distance image and per dimension weights for the integer passes
+  using IntegerDistanceType = uint32_t;
+  using IntegerDistanceImageType = typename itk::Image< IntegerDistanceType, TInputImage::ImageDimension >;
+  using IntegerWeightType = typename itk::FixedArray< IntegerDistanceType, TInputImage::ImageDimension >;
+
+  typename IntegerDistanceImageType::Pointer m_IntegerDistanceImage;
+
+  // 16 bit storage for the integer passes
+  using CompactDistanceType = uint16_t;
+  using CompactDistanceImageType = typename itk::Image< CompactDistanceType, TInputImage::ImageDimension >;
+
+  typename CompactDistanceImageType::Pointer m_CompactDistanceImage;
+
+  // distances and labels side by side for dilation
+  using InterleavedPixelType = LabSet::DistanceLabelPair< RealType, OutputPixelType >;
+  using InterleavedImageType = typename itk::Image< InterleavedPixelType, TInputImage::ImageDimension >;
+
+  typename InterleavedImageType::Pointer m_InterleavedImage;
+
+  // Incremental updates. The union of the edited regions, the
+  // filter's time when the last was marked, and whether the last
+  // update kept its results, in the slab output and distance images,
+  // for its output requested region.
+  bool                  m_UseIncrementalUpdate;
+  OutputImageRegionType m_DirtyRegion;
+  bool                  m_HasDirtyRegion;
+  ModifiedTimeType      m_DirtyMTime;
+  bool                  m_UpdatedIncrementally;
+  bool                  m_KeptResults;
+  OutputImageRegionType m_LastRequestedRegion;
+
+  bool CanUpdateIncrementally(const OutputImageRegionType & requested, const OutputImageRegionType & region) const;
+  void UpdateIncrementally(const OutputImageRegionType & requested, const OutputImageRegionType & region);
+
+  // the images the passes over the edited part use, which the kept
+  // ones are swapped with
+  void SwapEditImages();
+
+  typename DistanceImageType::Pointer        m_EditDistanceImage;
+  typename IntegerDistanceImageType::Pointer m_EditIntegerDistanceImage;
+  typename CompactDistanceImageType::Pointer m_EditCompactDistanceImage;
+  typename InterleavedImageType::Pointer     m_EditInterleavedImage;
+  typename TOutputImage::Pointer             m_EditOutputImage;
+
+  void ComputeIntegerWeights();
+
+  bool                m_IntegerPasses;
+  bool                m_CompactPasses;
+  bool                m_InterleavedPasses;
+  IntegerWeightType   m_IntegerWeight;
+  IntegerDistanceType m_IntegerCap;
+
+  int m_MagnitudeSign;
+  int m_CurrentDimension;
+
+  PassType m_Pass[TInputImage::ImageDimension];
+
+  // the work of a pass on a region, which the subclasses do
+  virtual void ThreadedPass(const OutputImageRegionType & region, const PassType & pass)
+  {
+    // stop warnings
+    (void)region;
+    (void)pass;
+  }
+
+  typename LabelImageType::Pointer           m_RotatedLabelImage[2];
+  typename DistanceImageType::Pointer        m_RotatedDistanceImage[2];
+  typename IntegerDistanceImageType::Pointer m_RotatedIntegerDistanceImage[2];
+  typename CompactDistanceImageType::Pointer m_RotatedCompactDistanceImage[2];
+
+  // allocate image for region, unless it already holds it. True if
+  // it was allocated.
+  template< typename TImage >
+  bool ReuseOrAllocate(TImage *image, const OutputImageRegionType & region) const;
+
+  template< typename TImage >
+  bool AllocateRotated(SmartPointer< TImage > *rotated, unsigned count,
+                       const OutputImageRegionType & region) const;
+
+  // gives image a pixel container in mapped files, or an ordinary
+  // one, as asked. True if it was changed.
+  template< typename TImage >
+  bool SelectPixelContainer(TImage *image) const;
+
+  // the region the passes are split over, and the label image the
+  // passes write to in place of the output when it is a slab, or the
+  // output requested region grown by a halo
+  OutputImageRegionType          m_PassRegion;
+  bool                           m_SlabPasses;
+  typename TOutputImage::Pointer m_SlabOutputImage;
+
+  TOutputImage * GetPassOutput()
+  {
+    return m_SlabPasses ? m_SlabOutputImage.GetPointer() : this->GetOutput();
+  }
+
+  // planes either side of a region along axis that can change its
+  // results, for the unnormalized scale of axis
+  SizeValueType GetHalo(unsigned axis, double scale) const;
+
+  // the smallest region holding every label voxel of the input in
+  // region, false if there are none
+  bool ComputeLabelBoundingBox(const OutputImageRegionType & region, OutputImageRegionType & box) const;
+
+  // bytes held by the internal buffers, and freeing them
+  SizeValueType GetBufferBytes() const;
+  void ReleaseBuffers();
+
+  template< typename TImage >
+  static SizeValueType GetBufferBytes(const TImage *image)
+  {
+    return image ? image->GetPixelContainer()->Capacity() * sizeof( typename TImage::PixelType ) : 0;
+  }
+
+  template< typename TImage >
+  static TImage * GetPassImage(TImage *image, const SmartPointer< TImage > *rotated, int buffer)
+  {
+    return ( buffer < 0 ) ? image : rotated[buffer].GetPointer();
+  }
+
+  // lines per lockstep block, 0 for the scalar code
+  unsigned m_NumberOfLanes;
+
+  // line buffers for the work units
+  LabSet::ScratchPool m_ScratchPool;
+
+  TileLinesType m_TileLines;
 
   // this is the first non-zero entry in the radius. Needed to
   // support elliptical operations
@@ -21,11 +21,14 @@
 #include "itkLabelSetMorphBaseImageFilter.h"
 #include "itkImageRegionConstIterator.h"
 #include "itkImageRegionIterator.h"
+#include "itkImageRegionConstIteratorWithIndex.h"
+#include "itkImageAlgorithm.h"
+#include "itkImageRegionExclusionIteratorWithIndex.h"
 
 #include "itkImageLinearIteratorWithIndex.h"
 #include "itkImageLinearConstIteratorWithIndex.h"
 
-#include "itkLabelSetUtils.h"
+#include "itkLabelSetLaneUtils.h"
 #include "itkImageFileWriter.h"
 
 namespace itk
@@ -39,6 +42,13 @@ LabelSetMorphBaseImageFilter< TInputImage, doDilate, TOutputImage >
 // needs to be selected according to erosion/dilation
 
   m_DistanceImage = DistanceImageType::New();
+  m_IntegerDistanceImage = IntegerDistanceImageType::New();
+  m_CompactDistanceImage = CompactDistanceImageType::New();
+  m_InterleavedImage = InterleavedImageType::New();
+  m_EditDistanceImage = DistanceImageType::New();
+  m_EditIntegerDistanceImage = IntegerDistanceImageType::New();
+  m_EditCompactDistanceImage = CompactDistanceImageType::New();
+  m_EditInterleavedImage = InterleavedImageType::New();
 
   if ( doDilate )
     {
@@ -51,10 +61,58 @@ LabelSetMorphBaseImageFilter< TInputImage, doDilate, TOutputImage >
     m_MagnitudeSign = -1;
     }
   m_UseImageSpacing = false;
+  m_UseEnvelopeAlgorithm = false;
+  m_UseVectorization = false;
+  m_UseIntegerArithmetic = false;
+  m_UseCompactDistanceImage = false;
+  m_UseRotatedLayout = false;
+  m_UseInterleavedBuffer = false;
+  m_MemoryPolicy = KeepDistanceImage;
+  m_SlabThickness = 32;
+  m_PeakMemoryBytes = 0;
+  m_MemoryBudget = 0;
+  m_UseMappedFiles = false;
+  m_MapBuffers = false;
+  m_SlabPasses = false;
+  m_PassScheduling = StaticPasses;
+  m_RegionScheduling = StaticPasses;
+  m_UseCostEstimate = false;
+  m_NumberOfSteals = 0;
+  m_NumberOfBlockAxes = 0;
+  m_InterleavedPasses = false;
+  m_IntegerPasses = false;
+  m_CompactPasses = false;
+  m_IntegerCap = 0;
+  m_NumberOfLanes = 0;
+
+  m_TileLines.Fill(16);
+  m_CurrentDimension = 0;
+  m_WavefrontFirst = 0;
+  m_WavefrontLast = 0;
+  m_GrainSize = 0;
+  m_UseFirstTouch = false;
+  m_UseThreadPinning = false;
+  m_TouchBlocks = false;
+  m_TouchOutput = false;
+  m_NewDistance = false;
+  m_NewRotated = false;
+  m_NewSlabOutput = false;
+  m_UseHugePages = false;
+  m_UseBoundingBox = false;
+  m_NumberOfPassVoxels = 0;
+  m_NumberOfBandVoxels = 0;
+  m_BandBlocks.Fill(0);
+  m_NumberOfHugePageBuffers = 0;
+  m_UseIncrementalUpdate = false;
+  m_HasDirtyRegion = false;
+  m_DirtyMTime = 0;
+  m_UpdatedIncrementally = false;
+  m_KeptResults = false;
 
   this->SetRadius(1);
 
   this->DynamicMultiThreadingOn();
+  this->InPlaceOff();
 }
 
 template< typename TInputImage, bool doDilate, typename TOutputImage >
@@ -62,8 +120,7 @@ void
 LabelSetMorphBaseImageFilter< TInputImage, doDilate, TOutputImage >
 ::DynamicThreadedGenerateData(const OutputImageRegionType & outputRegionForThread)
 {
-  // stop warnings
-  (void)outputRegionForThread;
+  this->ThreadedPass(outputRegionForThread, m_Pass[m_CurrentDimension]);
 }
 
 template< typename TInputImage, bool doDilate, typename TOutputImage >
@@ -71,49 +128,50 @@ RegionIndexType
 LabelSetMorphBaseImageFilter< TInputImage, doDilate, TOutputImage >
 ::SplitRequestedRegion(RegionIndexType i, RegionIndexType num, OutputImageRegionType & splitRegion)
 {
-  // Get the output pointer
-  OutputImageType *outputPtr = this->GetOutput();
-
-  // Initialize the splitRegion to the output requested region
-  splitRegion = outputPtr->GetRequestedRegion();
+  // Initialize the splitRegion to the region of this pass - the
+  // output requested region or a slab of it
+  splitRegion = m_PassRegion;
 
   const OutputSizeType & requestedRegionSize = splitRegion.GetSize();
 
   OutputIndexType splitIndex = splitRegion.GetIndex();
   OutputSizeType  splitSize  = splitRegion.GetSize();
 
-  // split on the outermost dimension available
-  // and avoid the current dimension
-  int splitAxis = static_cast< int >( outputPtr->GetImageDimension() ) - 1;
-  while ( ( requestedRegionSize[splitAxis] == 1 )
-          || ( splitAxis == static_cast< int >( m_CurrentDimension ) ) )
-    {
-    --splitAxis;
-    if ( splitAxis < 0 )
-      { // cannot split
-      itkDebugMacro("Cannot Split");
-      return 1;
-      }
+  // the pieces are made of whole granules, so no two share a cache
+  // line
+  unsigned      splitAxis[2];
+  SizeValueType granule[2];
+  SizeValueType granules[2];
+  SizeValueType pieces[2] = { 1, 1 };
+  const unsigned NumberOfAxes = this->GetSplitAxes(splitRegion, splitAxis, granule, granules);
+  if ( NumberOfAxes == 0 )
+    { // cannot split
+    itkDebugMacro("Cannot Split");
+    return 1;
     }
 
-  // determine the actual number of pieces that will be generated
-  auto range = static_cast< double >( requestedRegionSize[splitAxis] );
-
-  auto valuesPerThread = static_cast< unsigned int >( std::ceil( range / static_cast< double >( num ) ) );
-  unsigned int maxThreadIdUsed =
-    static_cast< unsigned int >( std::ceil( range / static_cast< double >( valuesPerThread ) ) ) - 1;
+  pieces[0] = std::min(granules[0], static_cast< SizeValueType >( num ) );
+  if ( NumberOfAxes > 1 )
+    {
+    pieces[1] = std::min(granules[1], static_cast< SizeValueType >( num ) / pieces[0]);
+    }
+  const RegionIndexType NumberOfPieces = static_cast< RegionIndexType >( pieces[0] * pieces[1] );
 
-  // Split the region
-  if ( i < maxThreadIdUsed )
+  if ( i >= NumberOfPieces )
     {
-    splitIndex[splitAxis] += i * valuesPerThread;
-    splitSize[splitAxis] = valuesPerThread;
+    return NumberOfPieces;
     }
-  if ( i == maxThreadIdUsed )
+
+  // Split the region
+  const SizeValueType piece[2] = { i % pieces[0], i / pieces[0] };
+  for ( unsigned k = 0; k < NumberOfAxes; k++ )
     {
-    splitIndex[splitAxis] += i * valuesPerThread;
-    // last thread needs to process the "rest" dimension being split
-    splitSize[splitAxis] = splitSize[splitAxis] - i * valuesPerThread;
+    const unsigned      axis = splitAxis[k];
+    const SizeValueType first = piece[k] * granules[k] / pieces[k] * granule[k];
+    const SizeValueType last = std::min(requestedRegionSize[axis],
+                                        ( piece[k] + 1 ) * granules[k] / pieces[k] * granule[k]);
+    splitIndex[axis] += static_cast< OutputIndexValueType >( first );
+    splitSize[axis] = last - first;
     }
 
   // set the split region ivars
@@ -122,135 +180,1768 @@ LabelSetMorphBaseImageFilter< TInputImage, doDilate, TOutputImage >
 
   itkDebugMacro("Split Piece: " << splitRegion);
 
-  return maxThreadIdUsed + 1;
+  return NumberOfPieces;
+}
+
+template< typename TInputImage, bool doDilate, typename TOutputImage >
+unsigned
+LabelSetMorphBaseImageFilter< TInputImage, doDilate, TOutputImage >
+::GetSplitAxes(const OutputImageRegionType & region, unsigned axis[2], SizeValueType granule[2],
+               SizeValueType granules[2]) const
+{
+  // the outermost dimension available, and the one inside it,
+  // avoiding the current dimension. The second is split as well if
+  // the first doesn't give a piece per work unit.
+  unsigned NumberOfAxes = 0;
+  for ( int P = static_cast< int >( ImageDimension ) - 1; P >= 0 && NumberOfAxes < 2; --P )
+    {
+    if ( region.GetSize()[P] > 1 && P != static_cast< int >( m_CurrentDimension ) )
+      {
+      axis[NumberOfAxes] = static_cast< unsigned >( P );
+      granule[NumberOfAxes] = this->GetSplitGranule(axis[NumberOfAxes], region, m_Pass[m_CurrentDimension]);
+      granules[NumberOfAxes] = ( region.GetSize()[P] + granule[NumberOfAxes] - 1 ) / granule[NumberOfAxes];
+      ++NumberOfAxes;
+      }
+    }
+  return NumberOfAxes;
+}
+
+template< typename TInputImage, bool doDilate, typename TOutputImage >
+SizeValueType
+LabelSetMorphBaseImageFilter< TInputImage, doDilate, TOutputImage >
+::ComputeBlocks(SizeValueType MinimumLines)
+{
+  // Blocks are one granule thick on the outer split axis, and on the
+  // inner one too if there wouldn't be several blocks per work unit
+  // otherwise. The inner granule is grown to give a block at least
+  // MinimumLines lines. Contiguous block numbers are neighbours.
+  const unsigned      NumberOfWorkUnits = this->GetMultiThreader()->GetNumberOfWorkUnits();
+  const SizeValueType BlocksPerWorkUnit = 4;
+  SizeValueType       granules[2];
+
+  m_NumberOfBlockAxes = this->GetSplitAxes(m_PassRegion, m_BlockAxis, m_BlockGranule, granules);
+  if ( m_NumberOfBlockAxes > 1 && granules[0] >= BlocksPerWorkUnit * NumberOfWorkUnits )
+    {
+    m_NumberOfBlockAxes = 1;
+    }
+  SizeValueType lines = m_PassRegion.GetNumberOfPixels() / m_PassRegion.GetSize()[m_CurrentDimension];
+  for ( unsigned k = 0; k < m_NumberOfBlockAxes; k++ )
+    {
+    lines = lines / m_PassRegion.GetSize()[m_BlockAxis[k]] * m_BlockGranule[k];
+    }
+  if ( m_NumberOfBlockAxes > 0 && lines < MinimumLines )
+    {
+    m_BlockGranule[m_NumberOfBlockAxes - 1] *= ( MinimumLines + lines - 1 ) / lines;
+    }
+  m_BlockCount[0] = 1;
+  m_BlockCount[1] = 1;
+  for ( unsigned k = 0; k < m_NumberOfBlockAxes; k++ )
+    {
+    const SizeValueType size = m_PassRegion.GetSize()[m_BlockAxis[k]];
+    m_BlockCount[k] = ( size + m_BlockGranule[k] - 1 ) / m_BlockGranule[k];
+    }
+  return m_BlockCount[0] * m_BlockCount[1];
 }
 
 template< typename TInputImage, bool doDilate, typename TOutputImage >
 void
 LabelSetMorphBaseImageFilter< TInputImage, doDilate, TOutputImage >
-::SetRadius(ScalarRealType radius)
+::ScheduleBlocks()
 {
-  RadiusType s;
+  // at least a tile of lines per block, so the lockstep lanes are
+  // kept busy
+  const SizeValueType NumberOfBlocks = this->ComputeBlocks(16);
 
-  s.Fill(radius);
-  this->SetRadius(s);
+  // The estimate is the number of voxels plus the number of label
+  // voxels, which cost more. The labels counted along the outer axis
+  // are shared out evenly along the inner one.
+  std::vector< double > cost;
+  if ( m_UseCostEstimate )
+    {
+    cost.resize(NumberOfBlocks);
+    for ( SizeValueType b = 0; b < NumberOfBlocks; b++ )
+      {
+      const OutputImageRegionType block = this->GetBlock(b);
+      double                      labels = static_cast< double >( block.GetNumberOfPixels() );
+      if ( m_NumberOfBlockAxes > 0 )
+        {
+        const unsigned       axis = m_BlockAxis[0];
+        const IndexValueType first = block.GetIndex()[axis] - m_PassRegion.GetIndex()[axis];
+        double               count = 0;
+        for ( SizeValueType k = 0; k < block.GetSize()[axis]; k++ )
+          {
+          count += m_LabelProfile[axis][first + k];
+          }
+        labels = count * block.GetNumberOfPixels()
+                 / ( block.GetSize()[axis] * ( m_PassRegion.GetNumberOfPixels() / m_PassRegion.GetSize()[axis] ) );
+        }
+      cost[b] = block.GetNumberOfPixels() + labels;
+      }
+    }
+  m_Scheduler.Initialize(this->GetMultiThreader()->GetNumberOfWorkUnits(), NumberOfBlocks, cost);
+}
+
+template< typename TInputImage, bool doDilate, typename TOutputImage >
+typename LabelSetMorphBaseImageFilter< TInputImage, doDilate, TOutputImage >::OutputImageRegionType
+LabelSetMorphBaseImageFilter< TInputImage, doDilate, TOutputImage >
+::GetBlock(SizeValueType block) const
+{
+  OutputImageRegionType region = m_PassRegion;
+  const SizeValueType   piece[2] = { block / m_BlockCount[1], block % m_BlockCount[1] };
+
+  for ( unsigned k = 0; k < m_NumberOfBlockAxes; k++ )
+    {
+    const unsigned      axis = m_BlockAxis[k];
+    const SizeValueType first = piece[k] * m_BlockGranule[k];
+    const SizeValueType last = std::min(m_PassRegion.GetSize()[axis], first + m_BlockGranule[k]);
+    region.SetIndex(axis, m_PassRegion.GetIndex()[axis] + static_cast< IndexValueType >( first ) );
+    region.SetSize(axis, last - first);
+    }
+  return region;
+}
+
+template< typename TInputImage, bool doDilate, typename TOutputImage >
+ITK_THREAD_RETURN_FUNCTION_CALL_CONVENTION
+LabelSetMorphBaseImageFilter< TInputImage, doDilate, TOutputImage >
+::StealingThreaderCallback(void *arg)
+{
+  using WorkUnitInfo = MultiThreaderBase::WorkUnitInfo;
+  auto *info = static_cast< WorkUnitInfo * >( arg );
+  auto *filter = static_cast< Self * >( info->UserData );
+
+  LabSet::ThreadPin pin(info->WorkUnitID, filter->m_UseThreadPinning);
+  SizeValueType     block;
+  while ( filter->m_Scheduler.Take(info->WorkUnitID, block) )
+    {
+    filter->DynamicThreadedGenerateData( filter->GetBlock(block) );
+    }
+  return ITK_THREAD_RETURN_DEFAULT_VALUE;
 }
 
 template< typename TInputImage, bool doDilate, typename TOutputImage >
 void
 LabelSetMorphBaseImageFilter< TInputImage, doDilate, TOutputImage >
-::EnlargeOutputRequestedRegion(DataObject *output)
+::ScheduleWavefront(unsigned first, unsigned last)
 {
-  auto *out = dynamic_cast< TOutputImage * >( output );
+  // blocks of planes along the last axis, a granule thick for every
+  // pass in the wavefront
+  const unsigned Axis = ImageDimension - 1;
+  SizeValueType  granule = 1;
 
-  if ( out )
+  for ( unsigned d = first; d <= last; d++ )
     {
-    out->SetRequestedRegion( out->GetLargestPossibleRegion() );
+    const SizeValueType g = this->GetSplitGranule(Axis, m_PassRegion, m_Pass[d]);
+    SizeValueType       a = granule, b = g;
+    while ( b != 0 )
+      {
+      const SizeValueType t = a % b;
+      a = b;
+      b = t;
+      }
+    granule = granule / a * g;
     }
+  m_WavefrontFirst = first;
+  m_WavefrontLast = last;
+  m_NumberOfBlockAxes = 1;
+  m_BlockAxis[0] = Axis;
+  m_BlockGranule[0] = granule;
+  m_BlockCount[0] = ( m_PassRegion.GetSize()[Axis] + granule - 1 ) / granule;
+  m_BlockCount[1] = 1;
+  m_Scheduler.Initialize( this->GetMultiThreader()->GetNumberOfWorkUnits(), m_BlockCount[0],
+                          std::vector< double >() );
 }
 
 template< typename TInputImage, bool doDilate, typename TOutputImage >
 void
 LabelSetMorphBaseImageFilter< TInputImage, doDilate, TOutputImage >
-::GenerateData(void)
+::ParallelizePass(unsigned dimension)
 {
-  ThreadIdType nbthreads = this->GetNumberOfWorkUnits();
+  // Hand the pass to the multithreader's own parallel for, which
+  // balances the load with its pool or TBB. With no grain size it is
+  // split by ITK, avoiding the pass's direction. Otherwise the blocks
+  // are those of work stealing, of at least GrainSize lines.
+  MultiThreaderBase *multithreader = this->GetMultiThreader();
+  const PassType &   pass = m_Pass[dimension];
 
-  typename TInputImage::ConstPointer inputImage( this->GetInput () );
-  typename TOutputImage::Pointer     outputImage( this->GetOutput() );
+  if ( m_GrainSize == 0 )
+    {
+    auto passOnRegion = [this, &pass](const OutputImageRegionType & region)
+      {
+      this->ThreadedPass(region, pass);
+      };
+    multithreader->ParallelizeImageRegionRestrictDirection< ImageDimension >(pass.Dimension, m_PassRegion,
+                                                                             passOnRegion, nullptr);
+    return;
+    }
 
-  this->AllocateOutputs();
+  const SizeValueType NumberOfBlocks = this->ComputeBlocks(m_GrainSize);
+  auto                passOnBlock = [this, &pass](SizeValueType block)
+    {
+    this->ThreadedPass(this->GetBlock(block), pass);
+    };
+  multithreader->ParallelizeArray(0, NumberOfBlocks, passOnBlock, nullptr);
+}
 
-  m_DistanceImage->SetBufferedRegion( outputImage->GetRequestedRegion() );
-  m_DistanceImage->Allocate();
-  m_DistanceImage->FillBuffer(0);
-  m_DistanceImage->CopyInformation(inputImage);
+template< typename TInputImage, bool doDilate, typename TOutputImage >
+ITK_THREAD_RETURN_FUNCTION_CALL_CONVENTION
+LabelSetMorphBaseImageFilter< TInputImage, doDilate, TOutputImage >
+::WavefrontThreaderCallback(void *arg)
+{
+  using WorkUnitInfo = MultiThreaderBase::WorkUnitInfo;
+  auto *info = static_cast< WorkUnitInfo * >( arg );
+  auto *filter = static_cast< Self * >( info->UserData );
 
-  if ( this->GetUseImageSpacing() )
+  LabSet::ThreadPin pin(info->WorkUnitID, filter->m_UseThreadPinning);
+  SizeValueType     block;
+  while ( filter->m_Scheduler.Take(info->WorkUnitID, block) )
     {
-    // radius is in mm
-    for ( unsigned P = 0; P < InputImageType::ImageDimension; P++ )
+    const OutputImageRegionType region = filter->GetBlock(block);
+    for ( unsigned d = filter->m_WavefrontFirst; d <= filter->m_WavefrontLast; d++ )
       {
-      m_Scale[P] = 0.5 * m_Radius[P] * m_Radius[P];
+      filter->ThreadedPass(region, filter->m_Pass[d]);
+      }
+    }
+  return ITK_THREAD_RETURN_DEFAULT_VALUE;
+}
+
+template< typename TInputImage, bool doDilate, typename TOutputImage >
+void
+LabelSetMorphBaseImageFilter< TInputImage, doDilate, TOutputImage >
+::FirstTouch(unsigned dimension)
+{
+  // Each work unit touches what it will be given by the pass along
+  // dimension - its starting share of the blocks with work stealing
+  // or the wavefront, otherwise its piece of the split. NativePasses
+  // has no fixed shares, so the split is used.
+  m_CurrentDimension = dimension;
+  m_TouchBlocks = false;
+  if ( m_RegionScheduling == WavefrontPasses )
+    {
+    this->ScheduleWavefront(0, ImageDimension - 2);
+    m_TouchBlocks = true;
+    }
+  else if ( m_RegionScheduling == StealingPasses )
+    {
+    this->ScheduleBlocks();
+    m_TouchBlocks = true;
+    }
+  MultiThreaderBase *multithreader = this->GetMultiThreader();
+  multithreader->SetSingleMethod(this->FirstTouchThreaderCallback, this);
+  multithreader->SingleMethodExecute();
+}
+
+template< typename TInputImage, bool doDilate, typename TOutputImage >
+ITK_THREAD_RETURN_FUNCTION_CALL_CONVENTION
+LabelSetMorphBaseImageFilter< TInputImage, doDilate, TOutputImage >
+::FirstTouchThreaderCallback(void *arg)
+{
+  using WorkUnitInfo = MultiThreaderBase::WorkUnitInfo;
+  auto *info = static_cast< WorkUnitInfo * >( arg );
+  auto *filter = static_cast< Self * >( info->UserData );
+
+  LabSet::ThreadPin pin(info->WorkUnitID, filter->m_UseThreadPinning && filter->m_RegionScheduling != NativePasses);
+  if ( filter->m_TouchBlocks )
+    {
+    SizeValueType begin, end;
+    filter->m_Scheduler.GetRange(info->WorkUnitID, begin, end);
+    for ( SizeValueType block = begin; block < end; block++ )
+      {
+      filter->TouchBuffers( filter->GetBlock(block) );
       }
     }
   else
     {
-    // radius is in pixels
-    RadiusType R;
-    // this gives us a little bit of a margin
-    for ( unsigned P = 0; P < InputImageType::ImageDimension; P++ )
+    OutputImageRegionType region;
+    const RegionIndexType pieces = filter->SplitRequestedRegion(info->WorkUnitID, info->NumberOfWorkUnits, region);
+    if ( info->WorkUnitID < pieces )
       {
-      m_Scale[P] = ( 0.5 * m_Radius[P] * m_Radius[P] + 1 );
+      filter->TouchBuffers(region);
       }
     }
+  return ITK_THREAD_RETURN_DEFAULT_VALUE;
+}
 
-  // set up the scaling parameter
-  // first non zero element of m_Scale sets the value used the first
-  // active pass over the image.
-  // Subsequent non zero values are scaled by the first non zero
-  // value to support elliptical operations.
-  // The first value needs to be recorded for use by the erosion operation.
-  unsigned firstval = 0;
-  for ( unsigned P = 0; P < InputImageType::ImageDimension; P++ )
+template< typename TInputImage, bool doDilate, typename TOutputImage >
+ITK_THREAD_RETURN_FUNCTION_CALL_CONVENTION
+LabelSetMorphBaseImageFilter< TInputImage, doDilate, TOutputImage >
+::PinnedThreaderCallback(void *arg)
+{
+  using WorkUnitInfo = MultiThreaderBase::WorkUnitInfo;
+  auto *info = static_cast< WorkUnitInfo * >( arg );
+
+  LabSet::ThreadPin pin(info->WorkUnitID, true);
+  return Self::ThreaderCallback(arg);
+}
+
+template< typename TInputImage, bool doDilate, typename TOutputImage >
+void
+LabelSetMorphBaseImageFilter< TInputImage, doDilate, TOutputImage >
+::TouchBuffers(const OutputImageRegionType & region)
+{
+  if ( m_TouchOutput )
     {
-    if ( m_Radius[P] != 0 )
+    TouchRegion(this->GetPassOutput(), region);
+    }
+  if ( m_NewDistance )
+    {
+    if ( m_InterleavedPasses )
       {
-      firstval = P;
-      break;
+      TouchRegion(m_InterleavedImage.GetPointer(), region);
+      }
+    else if ( m_CompactPasses )
+      {
+      TouchRegion(m_CompactDistanceImage.GetPointer(), region);
+      }
+    else if ( m_IntegerPasses )
+      {
+      TouchRegion(m_IntegerDistanceImage.GetPointer(), region);
+      }
+    else
+      {
+      TouchRegion(m_DistanceImage.GetPointer(), region);
       }
     }
-  m_BaseSigma = m_Scale[firstval];
-  for ( unsigned P = firstval + 1; P < InputImageType::ImageDimension; P++ )
+  if ( m_NewRotated )
     {
-    m_Scale[P] = m_Scale[P] / m_Scale[firstval];
+    for ( unsigned i = 0; i < 2; i++ )
+      {
+      TouchRegion(m_RotatedLabelImage[i].GetPointer(), region);
+      TouchRegion(m_RotatedDistanceImage[i].GetPointer(), region);
+      TouchRegion(m_RotatedIntegerDistanceImage[i].GetPointer(), region);
+      TouchRegion(m_RotatedCompactDistanceImage[i].GetPointer(), region);
+      }
     }
+}
 
-  m_FirstPassDone = false;
-
-  // Set up the multithreaded processing
-  typename ImageSource< TOutputImage >::ThreadStruct str;
-  str.Filter = this;
-  ProcessObject::MultiThreaderType *multithreader = this->GetMultiThreader();
-  multithreader->SetNumberOfWorkUnits(nbthreads);
-  multithreader->SetSingleMethod(this->ThreaderCallback, &str);
+template< typename TInputImage, bool doDilate, typename TOutputImage >
+template< typename TImage >
+void
+LabelSetMorphBaseImageFilter< TInputImage, doDilate, TOutputImage >
+::TouchRegion(TImage *image, const OutputImageRegionType & region)
+{
+  // nothing in it matters yet, so zeros will do
+  if ( image == nullptr )
+    {
+    return;
+    }
+  const typename TImage::PixelType Zero{};
+  ImageRegionIterator< TImage >    it(image, region);
+  for ( it.GoToBegin(); !it.IsAtEnd(); ++it )
+    {
+    it.Set(Zero);
+    }
+}
 
-  // multithread the execution
-  for ( unsigned int d = 0; d < ImageDimension; d++ )
+template< typename TInputImage, bool doDilate, typename TOutputImage >
+void
+LabelSetMorphBaseImageFilter< TInputImage, doDilate, TOutputImage >
+::AdviseHugePages()
+{
+  // before anything touches the new buffers
+  if ( m_NewSlabOutput )
     {
-    m_CurrentDimension = d;
-    multithreader->SingleMethodExecute();
-    if ( this->m_Scale[m_CurrentDimension] > 0 )
+    this->AdviseHugePages( m_SlabOutputImage.GetPointer() );
+    }
+  if ( m_NewDistance )
+    {
+    if ( m_InterleavedPasses )
       {
-      // needs to be set outside the multithreaded code
-      // first pass is completed as soon as we hit a structuring
-      // element dimension that is non zero.
-      m_FirstPassDone = true;
+      this->AdviseHugePages( m_InterleavedImage.GetPointer() );
+      }
+    else if ( m_CompactPasses )
+      {
+      this->AdviseHugePages( m_CompactDistanceImage.GetPointer() );
+      }
+    else if ( m_IntegerPasses )
+      {
+      this->AdviseHugePages( m_IntegerDistanceImage.GetPointer() );
+      }
+    else
+      {
+      this->AdviseHugePages( m_DistanceImage.GetPointer() );
+      }
+    }
+  if ( m_NewRotated )
+    {
+    for ( unsigned i = 0; i < 2; i++ )
+      {
+      this->AdviseHugePages( m_RotatedLabelImage[i].GetPointer() );
+      this->AdviseHugePages( m_RotatedDistanceImage[i].GetPointer() );
+      this->AdviseHugePages( m_RotatedIntegerDistanceImage[i].GetPointer() );
+      this->AdviseHugePages( m_RotatedCompactDistanceImage[i].GetPointer() );
       }
     }
 }
 
 template< typename TInputImage, bool doDilate, typename TOutputImage >
+template< typename TImage >
 void
 LabelSetMorphBaseImageFilter< TInputImage, doDilate, TOutputImage >
-::PrintSelf(std::ostream & os, Indent indent) const
+::AdviseHugePages(TImage *image)
 {
-  Superclass::PrintSelf(os, indent);
-  if ( m_UseImageSpacing )
+  if ( image == nullptr || image->GetBufferPointer() == nullptr )
     {
-    os << "Scale in world units: " << m_Radius << std::endl;
+    return;
+    }
+  if ( LabSet::AdviseHugePages( image->GetBufferPointer(), GetBufferBytes(image) ) )
+    {
+    ++m_NumberOfHugePageBuffers;
     }
   else
     {
-    os << "Scale in voxels: " << m_Radius << std::endl;
+    itkDebugMacro(<< "No huge pages for a buffer of " << GetBufferBytes(image) << " bytes");
     }
 }
 
 template< typename TInputImage, bool doDilate, typename TOutputImage >
 void
 LabelSetMorphBaseImageFilter< TInputImage, doDilate, TOutputImage >
-::writeDist(std::string fname)
+::ComputeNarrowBand(const OutputImageRegionType & region)
+{
+  // A voxel further than the reach of the radius along every axis
+  // from a pair of neighbours that differ has only its own label, or
+  // the background, that close. None of the passes change it or its
+  // distance, and where a pass along a line leaves its block it only
+  // meets voxels that don't change either, so the stretches of the
+  // line in the band give the same results on their own. The pairs
+  // mark their blocks, which are grown by the reach.
+  const SizeValueType B = BandBlockSize;
+  SizeValueType       stride[ImageDimension];
+  SizeValueType       NumberOfBlocks = 1;
+  for ( unsigned P = 0; P < ImageDimension; P++ )
+    {
+    m_BandBlocks[P] = ( region.GetSize()[P] + B - 1 ) / B;
+    stride[P] = NumberOfBlocks;
+    NumberOfBlocks *= m_BandBlocks[P];
+    }
+  std::vector< unsigned char > marked(NumberOfBlocks, 0);
+
+  const TInputImage *     input = this->GetInput();
+  const PixelType *       buffer = input->GetBufferPointer();
+  const OffsetValueType * table = input->GetOffsetTable();
+  const SizeValueType     LineLength = region.GetSize()[0];
+
+  ImageLinearConstIteratorWithIndex< TInputImage > it(input, region);
+  it.SetDirection(0);
+  for ( it.GoToBegin(); !it.IsAtEnd(); it.NextLine() )
+    {
+    const typename TInputImage::IndexType start = it.GetIndex();
+    const PixelType *                     line = buffer + input->ComputeOffset(start);
+    // the block row of this line, and of the line before it along
+    // each axis, if there is one
+    SizeValueType row = 0;
+    SizeValueType before[ImageDimension];
+    for ( unsigned P = 1; P < ImageDimension; P++ )
+      {
+      row += static_cast< SizeValueType >( start[P] - region.GetIndex()[P] ) / B * stride[P];
+      }
+    for ( unsigned P = 1; P < ImageDimension; P++ )
+      {
+      const SizeValueType offset = static_cast< SizeValueType >( start[P] - region.GetIndex()[P] );
+      before[P] = ( offset == 0 ) ? NumberOfBlocks : row - ( offset / B - ( offset - 1 ) / B ) * stride[P];
+      }
+    for ( SizeValueType x = 0; x < LineLength; x++ )
+      {
+      const PixelType     value = line[x];
+      const SizeValueType block = row + x / B;
+      if ( x > 0 && line[x - 1] != value )
+        {
+        marked[block] = 1;
+        marked[row + ( x - 1 ) / B] = 1;
+        }
+      for ( unsigned P = 1; P < ImageDimension; P++ )
+        {
+        if ( before[P] < NumberOfBlocks && line[static_cast< OffsetValueType >( x ) - table[P]] != value )
+          {
+          marked[block] = 1;
+          marked[before[P] + x / B] = 1;
+          }
+        }
+      }
+    }
+
+  // grow along each axis in turn
+  for ( unsigned P = 0; P < ImageDimension; P++ )
+    {
+    const SizeValueType Reach = this->GetHalo(P, m_UnnormalizedScale[P]);
+    const IndexValueType Grow = static_cast< IndexValueType >( ( Reach + B - 1 ) / B );
+    const IndexValueType Blocks = static_cast< IndexValueType >( m_BandBlocks[P] );
+    std::vector< unsigned char > grown(NumberOfBlocks, 0);
+    for ( SizeValueType b = 0; b < NumberOfBlocks; b++ )
+      {
+      if ( !marked[b] )
+        {
+        continue;
+        }
+      const IndexValueType at = static_cast< IndexValueType >( b / stride[P] % m_BandBlocks[P] );
+      const IndexValueType lo = std::max< IndexValueType >(at - Grow, 0);
+      const IndexValueType hi = std::min< IndexValueType >(at + Grow, Blocks - 1);
+      for ( IndexValueType k = lo; k <= hi; k++ )
+        {
+        grown[b + ( k - at ) * static_cast< IndexValueType >( stride[P] )] = 1;
+        }
+      }
+    marked.swap(grown);
+    }
+  m_ActiveBlocks.swap(marked);
+
+  for ( SizeValueType b = 0; b < NumberOfBlocks; b++ )
+    {
+    if ( m_ActiveBlocks[b] )
+      {
+      m_NumberOfBandVoxels += this->GetBandBlock(b).GetNumberOfPixels();
+      }
+    }
+  itkDebugMacro(<< "Narrow band of " << m_NumberOfBandVoxels << " voxels in " << region);
+}
+
+template< typename TInputImage, bool doDilate, typename TOutputImage >
+typename LabelSetMorphBaseImageFilter< TInputImage, doDilate, TOutputImage >::OutputImageRegionType
+LabelSetMorphBaseImageFilter< TInputImage, doDilate, TOutputImage >
+::GetBandBlock(SizeValueType block) const
+{
+  OutputImageRegionType region = m_PassRegion;
+
+  for ( unsigned P = 0; P < ImageDimension; P++ )
+    {
+    const SizeValueType first = block % m_BandBlocks[P] * BandBlockSize;
+    const SizeValueType last = std::min(m_PassRegion.GetSize()[P], first + BandBlockSize);
+    region.SetIndex(P, m_PassRegion.GetIndex()[P] + static_cast< IndexValueType >( first ) );
+    region.SetSize(P, last - first);
+    block /= m_BandBlocks[P];
+    }
+  return region;
+}
+
+template< typename TInputImage, bool doDilate, typename TOutputImage >
+void
+LabelSetMorphBaseImageFilter< TInputImage, doDilate, TOutputImage >
+::ScheduleBand(unsigned dimension)
+{
+  // the runs of active blocks along each row of blocks in dimension,
+  // costed by their size
+  SizeValueType stride = 1;
+  for ( unsigned P = 0; P < dimension; P++ )
+    {
+    stride *= m_BandBlocks[P];
+    }
+  const SizeValueType Run = m_BandBlocks[dimension];
+
+  m_BandRegions.clear();
+  std::vector< double > cost;
+  for ( SizeValueType b = 0; b < m_ActiveBlocks.size(); b++ )
+    {
+    if ( b / stride % Run != 0 )
+      {
+      continue;
+      }
+    for ( SizeValueType k = 0; k < Run; k++ )
+      {
+      if ( !m_ActiveBlocks[b + k * stride] )
+        {
+        continue;
+        }
+      SizeValueType end = k + 1;
+      while ( end < Run && m_ActiveBlocks[b + end * stride] )
+        {
+        ++end;
+        }
+      OutputImageRegionType region = this->GetBandBlock(b + k * stride);
+      const OutputImageRegionType last = this->GetBandBlock(b + ( end - 1 ) * stride);
+      region.SetSize(dimension, last.GetIndex()[dimension] + last.GetSize()[dimension] - region.GetIndex()[dimension]);
+      m_BandRegions.push_back(region);
+      cost.push_back( static_cast< double >( region.GetNumberOfPixels() ) );
+      k = end;
+      }
+    }
+  m_Scheduler.Initialize(this->GetMultiThreader()->GetNumberOfWorkUnits(), m_BandRegions.size(), cost);
+}
+
+template< typename TInputImage, bool doDilate, typename TOutputImage >
+ITK_THREAD_RETURN_FUNCTION_CALL_CONVENTION
+LabelSetMorphBaseImageFilter< TInputImage, doDilate, TOutputImage >
+::BandThreaderCallback(void *arg)
+{
+  using WorkUnitInfo = MultiThreaderBase::WorkUnitInfo;
+  auto *info = static_cast< WorkUnitInfo * >( arg );
+  auto *filter = static_cast< Self * >( info->UserData );
+
+  LabSet::ThreadPin pin(info->WorkUnitID, filter->m_UseThreadPinning);
+  SizeValueType     block;
+  while ( filter->m_Scheduler.Take(info->WorkUnitID, block) )
+    {
+    filter->DynamicThreadedGenerateData(filter->m_BandRegions[block]);
+    }
+  return ITK_THREAD_RETURN_DEFAULT_VALUE;
+}
+
+template< typename TInputImage, bool doDilate, typename TOutputImage >
+void
+LabelSetMorphBaseImageFilter< TInputImage, doDilate, TOutputImage >
+::CopyOutsideBand()
+{
+  // the voxels outside the band keep their labels
+  if ( this->GetRunningInPlace() )
+    {
+    return;
+    }
+  TOutputImage *output = this->GetPassOutput();
+  for ( SizeValueType b = 0; b < m_ActiveBlocks.size(); b++ )
+    {
+    if ( !m_ActiveBlocks[b] )
+      {
+      const OutputImageRegionType block = this->GetBandBlock(b);
+      ImageAlgorithm::Copy(this->GetInput(), output, block, block);
+      }
+    }
+}
+
+template< typename TInputImage, bool doDilate, typename TOutputImage >
+void
+LabelSetMorphBaseImageFilter< TInputImage, doDilate, TOutputImage >
+::ComputeLabelProfile(const OutputImageRegionType & region)
 {
+  // the number of label voxels in each plane across each axis
+  for ( unsigned P = 0; P < ImageDimension; P++ )
+    {
+    m_LabelProfile[P].assign(region.GetSize()[P], 0);
+    }
+  ImageRegionConstIteratorWithIndex< TInputImage > it(this->GetInput(), region);
+  for ( it.GoToBegin(); !it.IsAtEnd(); ++it )
+    {
+    if ( it.Get() != NumericTraits< PixelType >::ZeroValue() )
+      {
+      const typename TInputImage::IndexType & index = it.GetIndex();
+      for ( unsigned P = 0; P < ImageDimension; P++ )
+        {
+        ++m_LabelProfile[P][index[P] - region.GetIndex()[P]];
+        }
+      }
+    }
+}
+
+template< typename TInputImage, bool doDilate, typename TOutputImage >
+SizeValueType
+LabelSetMorphBaseImageFilter< TInputImage, doDilate, TOutputImage >
+::GetSplitGranule(unsigned axis, const OutputImageRegionType & region, const PassType & pass) const
+{
+  // The smallest step along axis that moves a whole number of cache
+  // lines through both the labels and the distances. The buffers of
+  // a pass hold region, so the strides come from its size. Along the
+  // axis the tiles are taken from a piece also holds whole tiles.
+  const SizeValueType CacheLine = 64;
+
+  SizeValueType DistanceBytes = sizeof( RealType );
+  if ( m_InterleavedPasses )
+    {
+    DistanceBytes = sizeof( InterleavedPixelType );
+    }
+  else if ( m_CompactPasses )
+    {
+    DistanceBytes = sizeof( CompactDistanceType );
+    }
+  else if ( m_IntegerPasses )
+    {
+    DistanceBytes = sizeof( IntegerDistanceType );
+    }
+
+  SizeValueType stride = 1;
+  for ( unsigned P = 0; P < axis; P++ )
+    {
+    stride *= region.GetSize()[P];
+    }
+
+  SizeValueType       granule = 1;
+  const SizeValueType PixelBytes[2] = { sizeof( OutputPixelType ), DistanceBytes };
+  for ( unsigned k = 0; k < 2; k++ )
+    {
+    // CacheLine / gcd(CacheLine, step)
+    SizeValueType a = CacheLine, b = stride * PixelBytes[k];
+    while ( b != 0 )
+      {
+      const SizeValueType t = a % b;
+      a = b;
+      b = t;
+      }
+    granule = std::max(granule, CacheLine / a);
+    }
+
+  unsigned TileAxis = 0;
+  for ( unsigned P = 0; P < ImageDimension; P++ )
+    {
+    if ( pass.WriteLayout[P] != pass.Dimension )
+      {
+      TileAxis = pass.WriteLayout[P];
+      break;
+      }
+    }
+  const SizeValueType TileLines = m_TileLines[pass.Dimension];
+  if ( axis == TileAxis && TileLines > 1 )
+    {
+    granule = ( granule + TileLines - 1 ) / TileLines * TileLines;
+    }
+  return granule;
+}
+
+template< typename TInputImage, bool doDilate, typename TOutputImage >
+void
+LabelSetMorphBaseImageFilter< TInputImage, doDilate, TOutputImage >
+::SetRadius(ScalarRealType radius)
+{
+  RadiusType s;
+
+  s.Fill(radius);
+  this->SetRadius(s);
+}
+
+template< typename TInputImage, bool doDilate, typename TOutputImage >
+void
+LabelSetMorphBaseImageFilter< TInputImage, doDilate, TOutputImage >
+::GenerateInputRequestedRegion()
+{
+  Superclass::GenerateInputRequestedRegion();
+
+  auto *input = const_cast< TInputImage * >( this->GetInput() );
+  if ( !input )
+    {
+    return;
+    }
+  this->ComputeScales();
+  input->SetRequestedRegion( this->GetPaddedRegion( this->GetOutput()->GetRequestedRegion() ) );
+}
+
+template< typename TInputImage, bool doDilate, typename TOutputImage >
+typename LabelSetMorphBaseImageFilter< TInputImage, doDilate, TOutputImage >::OutputImageRegionType
+LabelSetMorphBaseImageFilter< TInputImage, doDilate, TOutputImage >
+::GetPaddedRegion(const OutputImageRegionType & region) const
+{
+  // The slabs' halo on every axis. Beyond it nothing can change a
+  // result in region, and the edge of the padded region stands for
+  // the edge of the image.
+  OutputImageRegionType padded = region;
+  OutputSizeType        Grow;
+
+  for ( unsigned P = 0; P < ImageDimension; P++ )
+    {
+    Grow[P] = this->GetHalo(P, m_UnnormalizedScale[P]);
+    }
+  padded.PadByRadius(Grow);
+  padded.Crop( this->GetInput()->GetLargestPossibleRegion() );
+  return padded;
+}
+
+template< typename TInputImage, bool doDilate, typename TOutputImage >
+void
+LabelSetMorphBaseImageFilter< TInputImage, doDilate, TOutputImage >
+::ComputeScales()
+{
+  m_IntegerPasses = m_UseIntegerArithmetic && !m_UseImageSpacing;
+  m_CompactPasses = false;
+  if ( m_IntegerPasses )
+    {
+    this->ComputeIntegerWeights();
+    }
+  if ( m_IntegerPasses && m_UseCompactDistanceImage )
+    {
+    m_CompactPasses = ( m_IntegerCap <= NumericTraits< CompactDistanceType >::max() );
+    if ( !m_CompactPasses )
+      {
+      itkWarningMacro(<< "Radius " << m_Radius << " is too large for a 16 bit distance image, using 32 bits");
+      }
+    }
+  m_InterleavedPasses = doDilate && m_UseInterleavedBuffer && !m_IntegerPasses && !m_UseRotatedLayout;
+
+  if ( this->GetUseImageSpacing() )
+    {
+    // radius is in mm
+    for ( unsigned P = 0; P < InputImageType::ImageDimension; P++ )
+      {
+      m_Scale[P] = 0.5 * m_Radius[P] * m_Radius[P];
+      }
+    }
+  else
+    {
+    // radius is in pixels
+    RadiusType R;
+    // this gives us a little bit of a margin
+    for ( unsigned P = 0; P < InputImageType::ImageDimension; P++ )
+      {
+      m_Scale[P] = ( 0.5 * m_Radius[P] * m_Radius[P] + 1 );
+      }
+    }
+
+  // set up the scaling parameter
+  // first non zero element of m_Scale sets the value used the first
+  // active pass over the image.
+  // Subsequent non zero values are scaled by the first non zero
+  // value to support elliptical operations.
+  // The first value needs to be recorded for use by the erosion operation.
+  unsigned firstval = 0;
+  for ( unsigned P = 0; P < InputImageType::ImageDimension; P++ )
+    {
+    if ( m_Radius[P] != 0 )
+      {
+      firstval = P;
+      break;
+      }
+    }
+  m_BaseSigma = m_Scale[firstval];
+  m_UnnormalizedScale = m_Scale;
+  for ( unsigned P = firstval + 1; P < InputImageType::ImageDimension; P++ )
+    {
+    m_Scale[P] = m_Scale[P] / m_Scale[firstval];
+    }
+}
+
+template< typename TInputImage, bool doDilate, typename TOutputImage >
+void
+LabelSetMorphBaseImageFilter< TInputImage, doDilate, TOutputImage >
+::GenerateData(void)
+{
+  typename TInputImage::ConstPointer inputImage( this->GetInput () );
+  typename TOutputImage::Pointer     outputImage( this->GetOutput() );
+
+  this->AllocateOutputs();
+
+  this->ComputeScales();
+  if ( m_UseInterleavedBuffer && !m_InterleavedPasses )
+    {
+    itkWarningMacro(<< "Distances and labels can't be interleaved "
+                    << ( !doDilate ? "for erosion" : m_IntegerPasses ? "with integer arithmetic" : "in the rotated layout" )
+                    << ", keeping them apart");
+    }
+
+  m_MapBuffers = m_UseMappedFiles && LabSet::MappedFile::IsSupported();
+  if ( m_UseMappedFiles && !m_MapBuffers )
+    {
+    itkWarningMacro(<< "Memory mapped files aren't available, the buffers are held in memory");
+    }
+
+  m_NumberOfLanes = 0;
+  if ( m_UseVectorization )
+    {
+    m_NumberOfLanes = LabSet::GetNumberOfLanes();
+    }
+
+  m_PeakMemoryBytes = 0;
+  m_NumberOfSteals = 0;
+  m_NumberOfHugePageBuffers = 0;
+  m_NumberOfBandVoxels = 0;
+  m_NumberOfPassVoxels = 0;
+
+  // The passes run over the output requested region grown by the
+  // halo, and the results in the output requested region are kept.
+  const OutputImageRegionType Requested = outputImage->GetRequestedRegion();
+  OutputImageRegionType       Region = this->GetPaddedRegion(Requested);
+
+  m_UpdatedIncrementally = this->CanUpdateIncrementally(Requested, Region);
+  if ( m_UpdatedIncrementally )
+    {
+    this->UpdateIncrementally(Requested, Region);
+    return;
+    }
+
+  // the results over the region are kept for an incremental update,
+  // in the slab output
+  const bool Keep = m_UseIncrementalUpdate && !this->GetRunningInPlace()
+                    && m_MemoryPolicy == KeepDistanceImage && !m_UseBoundingBox;
+
+  // Only the box of the labels can change, grown by the reach of a
+  // dilation or by the background around them for an erosion. The
+  // rest is background already when running in place.
+  bool Empty = false;
+  if ( m_UseBoundingBox )
+    {
+    const OutputImageRegionType Padded = Region;
+    Empty = !this->ComputeLabelBoundingBox(Padded, Region);
+    if ( !Empty )
+      {
+      OutputSizeType Grow;
+      for ( unsigned P = 0; P < ImageDimension; P++ )
+        {
+        Grow[P] = doDilate ? this->GetHalo(P, m_UnnormalizedScale[P]) : 1;
+        }
+      Region.PadByRadius(Grow);
+      Region.Crop(Padded);
+      }
+    itkDebugMacro(<< "Bounding box " << Region);
+    OutputImageRegionType Inside = Region;
+    if ( !this->GetRunningInPlace() && ( Empty || !Inside.Crop(Requested) ) )
+      {
+      outputImage->FillBuffer( NumericTraits< OutputPixelType >::ZeroValue() );
+      }
+    else if ( !this->GetRunningInPlace() && Inside != Requested )
+      {
+      ImageRegionExclusionIteratorWithIndex< TOutputImage > it(outputImage, Requested);
+      it.SetExclusionRegion(Inside);
+      for ( it.GoToBegin(); !it.IsAtEnd(); ++it )
+        {
+        it.Set( NumericTraits< OutputPixelType >::ZeroValue() );
+        }
+      }
+    }
+
+  // the part of the output the passes produce
+  OutputImageRegionType Core = Region;
+  Empty = Empty || !Core.Crop(Requested);
+
+  // one arena per work unit, big enough for the longest line and the
+  // largest tiles
+  SizeValueType LongestLine = 0;
+  unsigned      MaxTileLines = 1;
+  for ( unsigned P = 0; P < ImageDimension; P++ )
+    {
+    LongestLine = std::max( LongestLine, Region.GetSize()[P] );
+    MaxTileLines = std::max(MaxTileLines, m_TileLines[P]);
+    }
+  m_ScratchPool.Initialize( LabSet::ScratchArena::GetBytesForLine(LongestLine, m_NumberOfLanes, MaxTileLines) );
+
+  // Slabs along the last axis, each grown by the planes that can
+  // change its results. Running in place the output would overwrite
+  // input the next slab reads. A region bigger than the output is
+  // one slab.
+  const unsigned      SlabAxis = ImageDimension - 1;
+  const SizeValueType Halo = this->GetHalo(SlabAxis, m_UnnormalizedScale[SlabAxis]);
+  const SizeValueType SlabThickness = ( m_MemoryBudget > 0 ) ? this->GetBudgetThickness(Region, Halo) : m_SlabThickness;
+  bool                Slabs = ( m_MemoryPolicy == SlabDistanceImage )
+                              && ( Region.GetSize()[SlabAxis] > SlabThickness + 2 * Halo );
+  if ( Slabs && this->GetRunningInPlace() )
+    {
+    itkWarningMacro(<< "Slab processing isn't possible in place, releasing the distance image instead");
+    Slabs = false;
+    }
+  m_SlabPasses = Slabs || ( Region != Core ) || Keep;
+
+  if ( Empty )
+    {
+    m_SlabPasses = false;
+    }
+  else if ( m_SlabPasses )
+    {
+    if ( m_SlabOutputImage.IsNull() )
+      {
+      m_SlabOutputImage = TOutputImage::New();
+      }
+    const IndexValueType Start = Core.GetIndex()[SlabAxis];
+    const IndexValueType End = Start + static_cast< IndexValueType >( Core.GetSize()[SlabAxis] );
+    const IndexValueType RegionStart = Region.GetIndex()[SlabAxis];
+    const IndexValueType RegionEnd = RegionStart + static_cast< IndexValueType >( Region.GetSize()[SlabAxis] );
+    const IndexValueType Thickness = Slabs ? static_cast< IndexValueType >( SlabThickness ) : End - Start;
+    const IndexValueType Grow = static_cast< IndexValueType >( Halo );
+    for ( IndexValueType first = Start; first < End; first += Thickness )
+      {
+      const IndexValueType last = std::min(first + Thickness, End);
+      const IndexValueType lo = std::max(first - Grow, RegionStart);
+      const IndexValueType hi = std::min(last + Grow, RegionEnd);
+
+      OutputImageRegionType Slab = Region;
+      Slab.SetIndex(SlabAxis, lo);
+      Slab.SetSize( SlabAxis, static_cast< SizeValueType >( hi - lo ) );
+      OutputImageRegionType SlabCore = Core;
+      SlabCore.SetIndex(SlabAxis, first);
+      SlabCore.SetSize( SlabAxis, static_cast< SizeValueType >( last - first ) );
+
+      m_NewSlabOutput = ReuseOrAllocate(m_SlabOutputImage.GetPointer(), Slab);
+      this->ProcessRegion(Slab);
+      ImageAlgorithm::Copy(m_SlabOutputImage.GetPointer(), outputImage.GetPointer(), SlabCore, SlabCore);
+      }
+    m_SlabPasses = false;
+    m_NewSlabOutput = false;
+    }
+  else
+    {
+    this->ProcessRegion(Region);
+    }
+
+  m_PeakMemoryBytes += m_ScratchPool.GetNumberOfBytes();
+  m_ScratchPool.Clear();
+  if ( m_MemoryPolicy != KeepDistanceImage )
+    {
+    this->ReleaseBuffers();
+    }
+
+  m_KeptResults = Keep && !Empty;
+  m_LastRequestedRegion = Requested;
+  m_HasDirtyRegion = false;
+}
+
+template< typename TInputImage, bool doDilate, typename TOutputImage >
+void
+LabelSetMorphBaseImageFilter< TInputImage, doDilate, TOutputImage >
+::AddDirtyRegion(const OutputImageRegionType & region)
+{
+  if ( !m_HasDirtyRegion )
+    {
+    m_DirtyRegion = region;
+    m_HasDirtyRegion = true;
+    }
+  else
+    {
+    // the smallest region holding both
+    for ( unsigned P = 0; P < ImageDimension; P++ )
+      {
+      const IndexValueType first = std::min( m_DirtyRegion.GetIndex()[P], region.GetIndex()[P] );
+      const IndexValueType last =
+        std::max( m_DirtyRegion.GetIndex()[P] + static_cast< IndexValueType >( m_DirtyRegion.GetSize()[P] ),
+                  region.GetIndex()[P] + static_cast< IndexValueType >( region.GetSize()[P] ) );
+      m_DirtyRegion.SetIndex(P, first);
+      m_DirtyRegion.SetSize( P, static_cast< SizeValueType >( last - first ) );
+      }
+    }
+  this->Modified();
+  m_DirtyMTime = this->GetMTime();
+}
+
+template< typename TInputImage, bool doDilate, typename TOutputImage >
+void
+LabelSetMorphBaseImageFilter< TInputImage, doDilate, TOutputImage >
+::AddDirtyIndex(const OutputIndexType & index)
+{
+  OutputSizeType One;
+  One.Fill(1);
+  this->AddDirtyRegion( OutputImageRegionType(index, One) );
+}
+
+template< typename TInputImage, bool doDilate, typename TOutputImage >
+bool
+LabelSetMorphBaseImageFilter< TInputImage, doDilate, TOutputImage >
+::CanUpdateIncrementally(const OutputImageRegionType & requested, const OutputImageRegionType & region) const
+{
+  // nothing but the marks has changed the filter since they were
+  // made, and the last update kept its results for the same region
+  if ( !m_UseIncrementalUpdate || !m_KeptResults || !m_HasDirtyRegion || this->GetMTime() != m_DirtyMTime
+       || requested != m_LastRequestedRegion || this->GetRunningInPlace() )
+    {
+    return false;
+    }
+
+  const ImageBase< ImageDimension > *distance = m_DistanceImage.GetPointer();
+  if ( m_InterleavedPasses )
+    {
+    distance = m_InterleavedImage.GetPointer();
+    }
+  else if ( m_CompactPasses )
+    {
+    distance = m_CompactDistanceImage.GetPointer();
+    }
+  else if ( m_IntegerPasses )
+    {
+    distance = m_IntegerDistanceImage.GetPointer();
+    }
+  return m_SlabOutputImage.IsNotNull() && m_SlabOutputImage->GetBufferedRegion() == region
+         && distance->GetBufferedRegion() == region;
+}
+
+template< typename TInputImage, bool doDilate, typename TOutputImage >
+void
+LabelSetMorphBaseImageFilter< TInputImage, doDilate, TOutputImage >
+::UpdateIncrementally(const OutputImageRegionType & requested, const OutputImageRegionType & region)
+{
+  // Only results within reach of an edit can change, and they only
+  // need the input within reach of themselves. The passes run over
+  // that with images of their own, and what they produce replaces
+  // the kept results. Where it meets the edge of the region it has
+  // the same edge as the last update had.
+  OutputSizeType Halo;
+  for ( unsigned P = 0; P < ImageDimension; P++ )
+    {
+    Halo[P] = this->GetHalo(P, m_UnnormalizedScale[P]);
+    }
+  OutputImageRegionType Changed = m_DirtyRegion;
+  Changed.PadByRadius(Halo);
+  if ( Changed.Crop(region) )
+    {
+    OutputImageRegionType Work = Changed;
+    Work.PadByRadius(Halo);
+    Work.Crop(region);
+
+    SizeValueType LongestLine = 0;
+    unsigned      MaxTileLines = 1;
+    for ( unsigned P = 0; P < ImageDimension; P++ )
+      {
+      LongestLine = std::max( LongestLine, Work.GetSize()[P] );
+      MaxTileLines = std::max(MaxTileLines, m_TileLines[P]);
+      }
+    m_ScratchPool.Initialize( LabSet::ScratchArena::GetBytesForLine(LongestLine, m_NumberOfLanes, MaxTileLines) );
+
+    this->SwapEditImages();
+    if ( m_SlabOutputImage.IsNull() )
+      {
+      m_SlabOutputImage = TOutputImage::New();
+      }
+    m_SlabPasses = true;
+    m_NewSlabOutput = ReuseOrAllocate(m_SlabOutputImage.GetPointer(), Work);
+    this->ProcessRegion(Work);
+    m_SlabPasses = false;
+    m_NewSlabOutput = false;
+    this->SwapEditImages();
+
+    ImageAlgorithm::Copy(m_EditOutputImage.GetPointer(), m_SlabOutputImage.GetPointer(), Changed, Changed);
+    if ( m_InterleavedPasses )
+      {
+      ImageAlgorithm::Copy(m_EditInterleavedImage.GetPointer(), m_InterleavedImage.GetPointer(), Changed, Changed);
+      }
+    else if ( m_CompactPasses )
+      {
+      ImageAlgorithm::Copy(m_EditCompactDistanceImage.GetPointer(), m_CompactDistanceImage.GetPointer(), Changed,
+                           Changed);
+      }
+    else if ( m_IntegerPasses )
+      {
+      ImageAlgorithm::Copy(m_EditIntegerDistanceImage.GetPointer(), m_IntegerDistanceImage.GetPointer(), Changed,
+                           Changed);
+      }
+    else
+      {
+      ImageAlgorithm::Copy(m_EditDistanceImage.GetPointer(), m_DistanceImage.GetPointer(), Changed, Changed);
+      }
+
+    m_PeakMemoryBytes = std::max( m_PeakMemoryBytes, this->GetBufferBytes()
+                                  + GetBufferBytes( m_EditDistanceImage.GetPointer() )
+                                  + GetBufferBytes( m_EditIntegerDistanceImage.GetPointer() )
+                                  + GetBufferBytes( m_EditCompactDistanceImage.GetPointer() )
+                                  + GetBufferBytes( m_EditInterleavedImage.GetPointer() )
+                                  + GetBufferBytes( m_EditOutputImage.GetPointer() ) );
+    m_EditDistanceImage->Initialize();
+    m_EditIntegerDistanceImage->Initialize();
+    m_EditCompactDistanceImage->Initialize();
+    m_EditInterleavedImage->Initialize();
+    m_EditOutputImage = nullptr;
+
+    m_PeakMemoryBytes += m_ScratchPool.GetNumberOfBytes();
+    m_ScratchPool.Clear();
+    }
+  else
+    {
+    m_PeakMemoryBytes = std::max( m_PeakMemoryBytes, this->GetBufferBytes() );
+    }
+
+  ImageAlgorithm::Copy(m_SlabOutputImage.GetPointer(), this->GetOutput(), requested, requested);
+  m_HasDirtyRegion = false;
+}
+
+template< typename TInputImage, bool doDilate, typename TOutputImage >
+void
+LabelSetMorphBaseImageFilter< TInputImage, doDilate, TOutputImage >
+::SwapEditImages()
+{
+  std::swap(m_DistanceImage, m_EditDistanceImage);
+  std::swap(m_IntegerDistanceImage, m_EditIntegerDistanceImage);
+  std::swap(m_CompactDistanceImage, m_EditCompactDistanceImage);
+  std::swap(m_InterleavedImage, m_EditInterleavedImage);
+  std::swap(m_SlabOutputImage, m_EditOutputImage);
+}
+
+template< typename TInputImage, bool doDilate, typename TOutputImage >
+void
+LabelSetMorphBaseImageFilter< TInputImage, doDilate, TOutputImage >
+::ProcessRegion(const OutputImageRegionType & Region)
+{
+  typename TInputImage::ConstPointer inputImage( this->GetInput () );
+
+  m_PassRegion = Region;
+  m_NumberOfPassVoxels += Region.GetNumberOfPixels();
+
+  // The buffers are kept from the last update if the region is the
+  // same. They don't need clearing - the first pass writes every
+  // pixel.
+  if ( m_InterleavedPasses )
+    {
+    m_NewDistance = ReuseOrAllocate(m_InterleavedImage.GetPointer(), Region);
+    m_InterleavedImage->CopyInformation(inputImage);
+    }
+  else if ( m_CompactPasses )
+    {
+    m_NewDistance = ReuseOrAllocate(m_CompactDistanceImage.GetPointer(), Region);
+    m_CompactDistanceImage->CopyInformation(inputImage);
+    }
+  else if ( m_IntegerPasses )
+    {
+    m_NewDistance = ReuseOrAllocate(m_IntegerDistanceImage.GetPointer(), Region);
+    m_IntegerDistanceImage->CopyInformation(inputImage);
+    }
+  else
+    {
+    m_NewDistance = ReuseOrAllocate(m_DistanceImage.GetPointer(), Region);
+    m_DistanceImage->CopyInformation(inputImage);
+    }
+
+  // Set up the multithreaded processing
+  typename ImageSource< TOutputImage >::ThreadStruct str;
+  str.Filter = this;
+  ProcessObject::MultiThreaderType *multithreader = this->GetMultiThreader();
+  multithreader->SetNumberOfWorkUnits( this->GetNumberOfWorkUnits() );
+
+  // The passes before the one along the last axis are all split on
+  // it, so a block of its planes depends only on the same block of
+  // the pass before. Without a third axis, or with a single plane,
+  // there is no wavefront and the passes are stolen.
+  const unsigned LastAxis = ImageDimension - 1;
+  m_RegionScheduling = m_PassScheduling;
+  if ( m_RegionScheduling == WavefrontPasses && ( LastAxis < 2 || Region.GetSize()[LastAxis] <= 1 ) )
+    {
+    m_RegionScheduling = StealingPasses;
+    }
+
+  if ( m_UseCostEstimate && ( m_RegionScheduling == StealingPasses || m_RegionScheduling == WavefrontPasses ) )
+    {
+    this->ComputeLabelProfile(Region);
+    }
+
+  // the passes that do some work. The integer passes process every
+  // dimension.
+  bool     Active[ImageDimension];
+  unsigned NumberOfActive = 0;
+  for ( unsigned P = 0; P < ImageDimension; P++ )
+    {
+    Active[P] = m_IntegerPasses || m_Scale[P] > 0;
+    NumberOfActive += Active[P];
+    }
+
+  // buffers for the rotating layout - the results of all but the last
+  // pass, alternately
+  const bool     Rotate = m_UseRotatedLayout && NumberOfActive > 1;
+  const unsigned NumberOfRotated = Rotate ? std::min(NumberOfActive - 1, 2u) : 0;
+  m_NewRotated = AllocateRotated(m_RotatedLabelImage, NumberOfRotated, Region);
+  if ( m_CompactPasses )
+    {
+    m_NewRotated |= AllocateRotated(m_RotatedCompactDistanceImage, NumberOfRotated, Region);
+    }
+  else if ( m_IntegerPasses )
+    {
+    m_NewRotated |= AllocateRotated(m_RotatedIntegerDistanceImage, NumberOfRotated, Region);
+    }
+  else
+    {
+    m_NewRotated |= AllocateRotated(m_RotatedDistanceImage, NumberOfRotated, Region);
+    }
+
+  m_PeakMemoryBytes = std::max( m_PeakMemoryBytes, this->GetBufferBytes() );
+  if ( m_UseHugePages )
+    {
+    this->AdviseHugePages();
+    }
+
+  // set up the passes
+  unsigned PassesDone = 0;
+  bool     FirstPassDone = false;
+  for ( unsigned int d = 0; d < ImageDimension; d++ )
+    {
+    PassType & pass = m_Pass[d];
+    pass.Dimension = d;
+    pass.FirstPassDone = FirstPassDone;
+    pass.LastPass = Active[d] && ( PassesDone + 1 == NumberOfActive );
+
+    // the next pass's axis, or 0 for the usual layout after the last
+    unsigned Next = 0;
+    for ( unsigned P = d + 1; P < ImageDimension && !pass.LastPass; P++ )
+      {
+      if ( Active[P] )
+        {
+        Next = P;
+        break;
+        }
+      }
+    pass.ReadBuffer = -1;
+    pass.WriteBuffer = -1;
+    for ( unsigned P = 0; P < ImageDimension; P++ )
+      {
+      pass.ReadLayout[P] = P;
+      pass.WriteLayout[P] = P;
+      }
+    if ( Rotate && Active[d] )
+      {
+      if ( PassesDone > 0 )
+        {
+        pass.ReadBuffer = ( PassesDone - 1 ) % 2;
+        for ( unsigned P = 0; P < ImageDimension; P++ )
+          {
+          pass.ReadLayout[P] = ( d + P ) % ImageDimension;
+          }
+        }
+      if ( !pass.LastPass )
+        {
+        pass.WriteBuffer = PassesDone % 2;
+        }
+      for ( unsigned P = 0; P < ImageDimension; P++ )
+        {
+        pass.WriteLayout[P] = ( Next + P ) % ImageDimension;
+        }
+      }
+
+    if ( this->m_Scale[d] > 0 )
+      {
+      // first pass is completed as soon as we hit a structuring
+      // element dimension that is non zero.
+      FirstPassDone = true;
+      }
+    PassesDone += Active[d];
+    }
+
+  const bool Wavefront = ( m_RegionScheduling == WavefrontPasses );
+
+  // The output is new each update, unless it is the input. The
+  // first touch follows the first pass that does some work.
+  m_TouchOutput = !this->GetRunningInPlace();
+  if ( m_UseFirstTouch && ( m_TouchOutput || m_NewDistance || m_NewRotated ) )
+    {
+    unsigned FirstActive = 0;
+    while ( FirstActive < LastAxis && !Active[FirstActive] )
+      {
+      ++FirstActive;
+      }
+    this->FirstTouch(Wavefront ? 0 : FirstActive);
+    }
+
+  if ( m_RegionScheduling == NarrowBandPasses )
+    {
+    this->ComputeNarrowBand(Region);
+    multithreader->SetSingleMethod(this->BandThreaderCallback, this);
+    for ( unsigned int d = 0; d < ImageDimension; d++ )
+      {
+      m_CurrentDimension = d;
+      this->ScheduleBand(d);
+      multithreader->SingleMethodExecute();
+      m_NumberOfSteals += m_Scheduler.GetNumberOfSteals();
+      }
+    this->CopyOutsideBand();
+    return;
+    }
+
+  unsigned FirstSeparate = 0;
+  if ( Wavefront )
+    {
+    FirstSeparate = LastAxis;
+    m_CurrentDimension = 0;
+    this->ScheduleWavefront(0, LastAxis - 1);
+    multithreader->SetSingleMethod(this->WavefrontThreaderCallback, this);
+    multithreader->SingleMethodExecute();
+    m_NumberOfSteals += m_Scheduler.GetNumberOfSteals();
+    }
+
+  // multithread the execution. The passes after the wavefront are
+  // stolen.
+  const bool Stealing = ( m_RegionScheduling == StealingPasses || Wavefront );
+  for ( unsigned int d = FirstSeparate; d < ImageDimension; d++ )
+    {
+    m_CurrentDimension = d;
+    if ( m_RegionScheduling == NativePasses )
+      {
+      this->ParallelizePass(d);
+      continue;
+      }
+    if ( Stealing )
+      {
+      this->ScheduleBlocks();
+      multithreader->SetSingleMethod(this->StealingThreaderCallback, this);
+      }
+    else if ( m_UseThreadPinning )
+      {
+      multithreader->SetSingleMethod(this->PinnedThreaderCallback, &str);
+      }
+    else
+      {
+      multithreader->SetSingleMethod(this->ThreaderCallback, &str);
+      }
+    multithreader->SingleMethodExecute();
+    if ( Stealing )
+      {
+      m_NumberOfSteals += m_Scheduler.GetNumberOfSteals();
+      }
+    }
+}
+
+template< typename TInputImage, bool doDilate, typename TOutputImage >
+SizeValueType
+LabelSetMorphBaseImageFilter< TInputImage, doDilate, TOutputImage >
+::GetHalo(unsigned Axis, double scale) const
+{
+  // A voxel further away along the axis than the reach of the
+  // parabola over the range of the distances never wins, so the
+  // planes beyond it can't change a result. The scale of the first
+  // pass is the range itself.
+  double reach = 0;
+
+  if ( m_IntegerPasses )
+    {
+    reach = std::sqrt( static_cast< double >( m_IntegerCap ) / m_IntegerWeight[Axis] );
+    }
+  else if ( scale > 0 )
+    {
+    const double iscale = m_UseImageSpacing ? this->GetInput()->GetSpacing()[Axis] : 1.0;
+    reach = std::sqrt(2.0 * scale) / iscale;
+    }
+  return static_cast< SizeValueType >( std::ceil(reach) ) + 1;
+}
+
+template< typename TInputImage, bool doDilate, typename TOutputImage >
+bool
+LabelSetMorphBaseImageFilter< TInputImage, doDilate, TOutputImage >
+::ComputeLabelBoundingBox(const OutputImageRegionType & region, OutputImageRegionType & box) const
+{
+  // a line at a time along the first axis, which only needs its
+  // first and last label voxels
+  OutputIndexType lo = region.GetUpperIndex();
+  OutputIndexType hi = region.GetIndex();
+  bool            found = false;
+
+  ImageLinearConstIteratorWithIndex< TInputImage > it(this->GetInput(), region);
+  it.SetDirection(0);
+  for ( it.GoToBegin(); !it.IsAtEnd(); it.NextLine() )
+    {
+    const typename TInputImage::IndexType start = it.GetIndex();
+    IndexValueType                        first = -1, last = -1;
+    for ( IndexValueType x = 0; !it.IsAtEndOfLine(); ++it, ++x )
+      {
+      if ( it.Get() != NumericTraits< PixelType >::ZeroValue() )
+        {
+        if ( first < 0 )
+          {
+          first = x;
+          }
+        last = x;
+        }
+      }
+    if ( first < 0 )
+      {
+      continue;
+      }
+    found = true;
+    lo[0] = std::min(lo[0], start[0] + first);
+    hi[0] = std::max(hi[0], start[0] + last);
+    for ( unsigned P = 1; P < ImageDimension; P++ )
+      {
+      lo[P] = std::min(lo[P], start[P]);
+      hi[P] = std::max(hi[P], start[P]);
+      }
+    }
+  if ( found )
+    {
+    box.SetIndex(lo);
+    box.SetUpperIndex(hi);
+    }
+  return found;
+}
+
+template< typename TInputImage, bool doDilate, typename TOutputImage >
+SizeValueType
+LabelSetMorphBaseImageFilter< TInputImage, doDilate, TOutputImage >
+::GetBufferBytes() const
+{
+  SizeValueType bytes = GetBufferBytes( m_DistanceImage.GetPointer() )
+                        + GetBufferBytes( m_IntegerDistanceImage.GetPointer() )
+                        + GetBufferBytes( m_CompactDistanceImage.GetPointer() )
+                        + GetBufferBytes( m_InterleavedImage.GetPointer() )
+                        + GetBufferBytes( m_SlabOutputImage.GetPointer() );
+
+  for ( unsigned i = 0; i < 2; i++ )
+    {
+    bytes += GetBufferBytes( m_RotatedLabelImage[i].GetPointer() )
+             + GetBufferBytes( m_RotatedDistanceImage[i].GetPointer() )
+             + GetBufferBytes( m_RotatedIntegerDistanceImage[i].GetPointer() )
+             + GetBufferBytes( m_RotatedCompactDistanceImage[i].GetPointer() );
+    }
+  return bytes;
+}
+
+template< typename TInputImage, bool doDilate, typename TOutputImage >
+void
+LabelSetMorphBaseImageFilter< TInputImage, doDilate, TOutputImage >
+::ReleaseBuffers()
+{
+  m_DistanceImage->Initialize();
+  m_IntegerDistanceImage->Initialize();
+  m_CompactDistanceImage->Initialize();
+  m_InterleavedImage->Initialize();
+  m_SlabOutputImage = nullptr;
+  for ( unsigned i = 0; i < 2; i++ )
+    {
+    m_RotatedLabelImage[i] = nullptr;
+    m_RotatedDistanceImage[i] = nullptr;
+    m_RotatedIntegerDistanceImage[i] = nullptr;
+    m_RotatedCompactDistanceImage[i] = nullptr;
+    }
+}
+
+template< typename TInputImage, bool doDilate, typename TOutputImage >
+template< typename TImage >
+bool
+LabelSetMorphBaseImageFilter< TInputImage, doDilate, TOutputImage >
+::ReuseOrAllocate(TImage *image, const OutputImageRegionType & region) const
+{
+  const bool Changed = this->SelectPixelContainer(image);
+
+  if ( Changed || image->GetBufferPointer() == nullptr || image->GetBufferedRegion() != region )
+    {
+    image->SetBufferedRegion(region);
+    image->Allocate();
+    return true;
+    }
+  return false;
+}
+
+template< typename TInputImage, bool doDilate, typename TOutputImage >
+template< typename TImage >
+bool
+LabelSetMorphBaseImageFilter< TInputImage, doDilate, TOutputImage >
+::AllocateRotated(SmartPointer< TImage > *rotated, unsigned count, const OutputImageRegionType & region) const
+{
+  // the first count buffers are allocated, or reused, the rest
+  // released
+  bool allocated = false;
+  for ( unsigned i = 0; i < 2; i++ )
+    {
+    if ( i < count )
+      {
+      if ( rotated[i].IsNull() )
+        {
+        rotated[i] = TImage::New();
+        }
+      allocated |= ReuseOrAllocate(rotated[i].GetPointer(), region);
+      }
+    else
+      {
+      rotated[i] = nullptr;
+      }
+    }
+  return allocated;
+}
+
+template< typename TInputImage, bool doDilate, typename TOutputImage >
+template< typename TImage >
+bool
+LabelSetMorphBaseImageFilter< TInputImage, doDilate, TOutputImage >
+::SelectPixelContainer(TImage *image) const
+{
+  using MappedContainerType = LabSet::MappedImageContainer< SizeValueType, typename TImage::PixelType >;
+
+  auto *mapped = dynamic_cast< MappedContainerType * >( image->GetPixelContainer() );
+  if ( m_MapBuffers && !mapped )
+    {
+    typename MappedContainerType::Pointer container = MappedContainerType::New();
+    container->SetDirectory(m_TemporaryDirectory);
+    image->SetPixelContainer(container);
+    return true;
+    }
+  if ( !m_MapBuffers && mapped )
+    {
+    image->SetPixelContainer( TImage::PixelContainer::New() );
+    return true;
+    }
+  if ( mapped && mapped->GetDirectory() != m_TemporaryDirectory )
+    {
+    // new files for the next allocation
+    mapped->SetDirectory(m_TemporaryDirectory);
+    }
+  return false;
+}
+
+template< typename TInputImage, bool doDilate, typename TOutputImage >
+SizeValueType
+LabelSetMorphBaseImageFilter< TInputImage, doDilate, TOutputImage >
+::GetBytesPerPixel() const
+{
+  // the distance image, the slab output and, with the rotating
+  // layout, up to two copies of each
+  SizeValueType Distance = sizeof( RealType );
+  if ( m_InterleavedPasses )
+    {
+    Distance = sizeof( InterleavedPixelType );
+    }
+  else if ( m_CompactPasses )
+    {
+    Distance = sizeof( CompactDistanceType );
+    }
+  else if ( m_IntegerPasses )
+    {
+    Distance = sizeof( IntegerDistanceType );
+    }
+  const SizeValueType Rotated = m_UseRotatedLayout ? ( ImageDimension > 2 ? 2 : ImageDimension - 1 ) : 0;
+  return Distance * ( 1 + Rotated ) + sizeof( OutputPixelType )
+         + Rotated * sizeof( typename LabelImageType::PixelType );
+}
+
+template< typename TInputImage, bool doDilate, typename TOutputImage >
+SizeValueType
+LabelSetMorphBaseImageFilter< TInputImage, doDilate, TOutputImage >
+::GetBudgetThickness(const OutputImageRegionType & region, const SizeValueType halo) const
+{
+  const unsigned      SlabAxis = ImageDimension - 1;
+  const SizeValueType PlaneBytes = region.GetNumberOfPixels() / region.GetSize()[SlabAxis] * this->GetBytesPerPixel();
+  const SizeValueType Planes = m_MemoryBudget / PlaneBytes;
+
+  if ( Planes <= 2 * halo + 1 )
+    {
+    itkWarningMacro(<< "A memory budget of " << m_MemoryBudget << " bytes doesn't hold a slab of "
+                    << 2 * halo + 1 << " planes, using slabs of one plane");
+    return 1;
+    }
+  return Planes - 2 * halo;
+}
+
+template< typename TInputImage, bool doDilate, typename TOutputImage >
+void
+LabelSetMorphBaseImageFilter< TInputImage, doDilate, TOutputImage >
+::ComputeIntegerWeights()
+{
+  // The structuring element is sum_i d_i^2 / r_i^2 <= 1. Multiplying
+  // through by L, the lowest common multiple of the r_i^2, gives
+  // integer weights w_i = L / r_i^2 and the test
+  // sum_i w_i * d_i^2 < L + 1, which is the saturation value. A zero
+  // radius gets the saturation value as its weight, so nothing
+  // spreads along that axis, and neither does a radius below 1. If
+  // all the non zero radii are the same they needn't be whole
+  // numbers - the test is d^2 <= floor(r^2).
+  using WideType = unsigned long long;
+  const WideType Limit = static_cast< WideType >( NumericTraits< int32_t >::max() );
+
+  bool           isotropic = true;
+  ScalarRealType common = 0;
+  for ( unsigned P = 0; P < ImageDimension; P++ )
+    {
+    if ( m_Radius[P] < 0 )
+      {
+      itkExceptionMacro(<< "Negative radius " << m_Radius);
+      }
+    if ( m_Radius[P] > 0 )
+      {
+      if ( common > 0 && m_Radius[P] != common )
+        {
+        isotropic = false;
+        }
+      common = m_Radius[P];
+      }
+    }
+
+  WideType L = 0;
+  WideType R2[ImageDimension];
+  for ( unsigned P = 0; P < ImageDimension; P++ )
+    {
+    R2[P] = 0;
+    if ( m_Radius[P] == 0 )
+      {
+      continue;
+      }
+    const double sq = static_cast< double >( m_Radius[P] ) * m_Radius[P];
+    if ( !isotropic && m_Radius[P] != std::floor(m_Radius[P]) )
+      {
+      itkExceptionMacro(<< "Integer arithmetic needs whole number radii when they differ: " << m_Radius);
+      }
+    if ( sq >= Limit )
+      {
+      itkExceptionMacro(<< "Radius too large for integer arithmetic: " << m_Radius);
+      }
+    R2[P] = static_cast< WideType >( std::floor(sq) );
+    if ( R2[P] == 0 )
+      {
+      // radius below 1 - same as 0
+      continue;
+      }
+    WideType a = L, b = R2[P];
+    while ( b != 0 )
+      {
+      const WideType t = a % b;
+      a = b;
+      b = t;
+      }
+    L = ( L == 0 ) ? R2[P] : L / a * R2[P];
+    if ( L >= Limit )
+      {
+      itkExceptionMacro(<< "Radii " << m_Radius << " have no common multiple of their squares small enough for integer arithmetic");
+      }
+    }
+
+  m_IntegerCap = static_cast< IntegerDistanceType >( L + 1 );
+  for ( unsigned P = 0; P < ImageDimension; P++ )
+    {
+    if ( R2[P] == 0 )
+      {
+      m_IntegerWeight[P] = m_IntegerCap;
+      }
+    else
+      {
+      m_IntegerWeight[P] = static_cast< IntegerDistanceType >( L / R2[P] );
+      }
+    }
+}
+
+template< typename TInputImage, bool doDilate, typename TOutputImage >
+void
+LabelSetMorphBaseImageFilter< TInputImage, doDilate, TOutputImage >
+::PrintSelf(std::ostream & os, Indent indent) const
+{
+  Superclass::PrintSelf(os, indent);
+  if ( m_UseImageSpacing )
+    {
+    os << "Scale in world units: " << m_Radius << std::endl;
+    }
+  else
+    {
+    os << "Scale in voxels: " << m_Radius << std::endl;
+    }
+  os << "UseEnvelopeAlgorithm: " << m_UseEnvelopeAlgorithm << std::endl;
+  os << "UseVectorization: " << m_UseVectorization << std::endl;
+  os << "UseIntegerArithmetic: " << m_UseIntegerArithmetic << std::endl;
+  os << "UseCompactDistanceImage: " << m_UseCompactDistanceImage << std::endl;
+  os << "TileLines: " << m_TileLines << std::endl;
+  os << "UseRotatedLayout: " << m_UseRotatedLayout << std::endl;
+  os << "UseInterleavedBuffer: " << m_UseInterleavedBuffer << std::endl;
+  os << "MemoryPolicy: " << m_MemoryPolicy << std::endl;
+  os << "SlabThickness: " << m_SlabThickness << std::endl;
+  os << "MemoryBudget: " << m_MemoryBudget << std::endl;
+  os << "UseMappedFiles: " << m_UseMappedFiles << std::endl;
+  os << "TemporaryDirectory: " << m_TemporaryDirectory << std::endl;
+  os << "UseIncrementalUpdate: " << m_UseIncrementalUpdate << std::endl;
+  os << "PeakMemoryBytes: " << m_PeakMemoryBytes << std::endl;
+  os << "PassScheduling: " << m_PassScheduling << std::endl;
+  os << "UseCostEstimate: " << m_UseCostEstimate << std::endl;
+  os << "GrainSize: " << m_GrainSize << std::endl;
+  os << "UseFirstTouch: " << m_UseFirstTouch << std::endl;
+  os << "UseThreadPinning: " << m_UseThreadPinning << std::endl;
+  os << "UseHugePages: " << m_UseHugePages << std::endl;
+  os << "UseBoundingBox: " << m_UseBoundingBox << std::endl;
+}
+
+template< typename TInputImage, bool doDilate, typename TOutputImage >
+void
+LabelSetMorphBaseImageFilter< TInputImage, doDilate, TOutputImage >
+::writeDist(std::string fname)
+{
+  if ( m_MemoryPolicy != KeepDistanceImage )
+    {
+    itkExceptionMacro(<< "The distance image isn't kept with memory policy " << m_MemoryPolicy);
+    }
+  if ( m_CompactPasses )
+    {
+    using CompactWriterType = typename itk::ImageFileWriter< CompactDistanceImageType >;
+    typename CompactWriterType::Pointer writer = CompactWriterType::New();
+    writer->SetInput(m_CompactDistanceImage);
+    writer->SetFileName( fname.c_str() );
+    writer->Update();
+    return;
+    }
+  if ( m_IntegerPasses )
+    {
+    using IntegerWriterType = typename itk::ImageFileWriter< IntegerDistanceImageType >;
+    typename IntegerWriterType::Pointer writer = IntegerWriterType::New();
+    writer->SetInput(m_IntegerDistanceImage);
+    writer->SetFileName( fname.c_str() );
+    writer->Update();
+    return;
+    }
+  if ( m_InterleavedPasses )
+    {
+    // split the distances out of the pairs
+    ReuseOrAllocate( m_DistanceImage.GetPointer(), m_InterleavedImage->GetBufferedRegion() );
+    m_DistanceImage->CopyInformation(m_InterleavedImage);
+    const InterleavedPixelType *src = m_InterleavedImage->GetBufferPointer();
+    RealType *                  dst = m_DistanceImage->GetBufferPointer();
+    const SizeValueType         n = m_DistanceImage->GetBufferedRegion().GetNumberOfPixels();
+    for ( SizeValueType i = 0; i < n; i++ )
+      {
+      dst[i] = src[i].Distance;
+      }
+    }
   using WriterType = typename  itk::ImageFileWriter< DistanceImageType >;
   typename WriterType::Pointer writer = WriterType::New();
   writer->SetInput(m_DistanceImage);
@@ -0,0 +1,319 @@
+/*=========================================================================
+ *
+ *  Copyright Insight Software Consortium
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+#ifndef itkLabelSetScratchArena_h
+#define itkLabelSetScratchArena_h
+
+#include "itkIntTypes.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// Scratch space for the line buffers. Each work unit borrows an arena
+// from the filter's pool and the per-line operations take their
+// buffers from it, stack fashion, instead of the heap. The arenas are
+// sized in GenerateData to hold the buffers for the longest line, so
+// a thread allocates once however many lines and label runs it
+// processes. If a buffer doesn't fit it comes from the heap, and the
+// arena grows to the high water mark when it is next empty. Every
+// heap allocation is counted so tests can check this.
+namespace itk
+{
+namespace LabSet
+{
+class ScratchArena
+{
+public:
+  static constexpr std::size_t Alignment = 64;
+
+  // space for the buffers of the largest per-line operation - the
+  // erosion with the envelope algorithm has 10 buffers of at most 8
+  // byte elements. Allow that many per lane, plus alignment. A pass has up
+  // to 5 line accessors, each of which may hold a tile of lines.
+  static std::size_t GetBytesForLine(const std::size_t LineLength, const unsigned Lanes,
+                                     const unsigned TileLines = 1)
+  {
+    const std::size_t lanes = std::max(1u, Lanes);
+    const std::size_t tiles = ( TileLines > 1 ) ? 5 * ( TileLines * LineLength * sizeof( double ) + Alignment ) : 0;
+
+    return 10 * ( lanes * ( LineLength + 2 ) * sizeof( double ) + Alignment ) + tiles;
+  }
+
+  ScratchArena(const std::size_t bytes, std::atomic< SizeValueType > & allocations) :
+    m_Capacity(0), m_Top(0), m_HighWater(0), m_Allocations(allocations)
+  {
+    this->Reserve(bytes);
+  }
+
+  // a position in the arena to return to
+  struct Mark
+  {
+    std::size_t top;
+    std::size_t overflow;
+  };
+
+  Mark GetMark() const
+  {
+    Mark m = { m_Top, m_Overflow.size() };
+
+    return m;
+  }
+
+  std::size_t GetCapacity() const
+  {
+    return m_Capacity;
+  }
+
+  void Release(const Mark & m)
+  {
+    m_Top = m.top;
+    m_Overflow.resize(m.overflow);
+    if ( m_Top == 0 && m_Overflow.empty() && m_HighWater > m_Capacity )
+      {
+      this->Reserve(m_HighWater);
+      }
+  }
+
+  template< class T >
+  T * Allocate(const std::size_t n)
+  {
+    const std::size_t bytes = ( n * sizeof( T ) + Alignment - 1 ) / Alignment * Alignment;
+
+    m_HighWater = std::max(m_HighWater, m_Top + bytes);
+    if ( m_Overflow.empty() && m_Top + bytes <= m_Capacity )
+      {
+      T *p = reinterpret_cast< T * >( m_Data + m_Top );
+      m_Top += bytes;
+      return p;
+      }
+    // doesn't fit - take it from the heap until the arena is next
+    // released to this point
+    m_Top += bytes;
+    m_Overflow.push_back( Block(bytes) );
+    ++m_Allocations;
+    return reinterpret_cast< T * >( m_Overflow.back().data );
+  }
+
+private:
+  struct Block
+  {
+    Block(const std::size_t bytes = 0) :
+      storage(bytes ? new char[bytes + Alignment] : nullptr), data(nullptr)
+    {
+      if ( bytes )
+        {
+        const std::uintptr_t a = reinterpret_cast< std::uintptr_t >( storage.get() );
+        data = storage.get() + ( Alignment - a % Alignment ) % Alignment;
+        }
+    }
+
+    std::unique_ptr< char[] > storage;
+    char *                    data;
+  };
+
+  void Reserve(const std::size_t bytes)
+  {
+    m_Block = Block(bytes);
+    m_Data = m_Block.data;
+    m_Capacity = bytes;
+    ++m_Allocations;
+  }
+
+  Block                          m_Block;
+  char *                         m_Data;
+  std::size_t                    m_Capacity;
+  std::size_t                    m_Top;
+  std::size_t                    m_HighWater;
+  std::vector< Block >           m_Overflow;
+  std::atomic< SizeValueType > & m_Allocations;
+};
+
+// returns the arena to the mark it had when constructed
+class ScratchScope
+{
+public:
+  ScratchScope(ScratchArena & arena) :
+    m_Arena(arena), m_Mark( arena.GetMark() )
+  {}
+
+  ~ScratchScope()
+  {
+    m_Arena.Release(m_Mark);
+  }
+
+private:
+  ScratchArena &     m_Arena;
+  ScratchArena::Mark m_Mark;
+};
+
+// a buffer taken from an arena, standing in for itk::Array in the
+// per-line operations. It is only valid until the arena is released
+// past the point it was taken.
+template< class T >
+class ScratchBuffer
+{
+public:
+  using ValueType = T;
+
+  ScratchBuffer(ScratchArena & arena, const std::size_t n) :
+    m_Data( arena.Allocate< T >(n) ), m_Size(n)
+  {}
+
+  T & operator[](const std::size_t i)
+  {
+    return m_Data[i];
+  }
+
+  const T & operator[](const std::size_t i) const
+  {
+    return m_Data[i];
+  }
+
+  std::size_t size() const
+  {
+    return m_Size;
+  }
+
+  T * begin()
+  {
+    return m_Data;
+  }
+
+  T * end()
+  {
+    return m_Data + m_Size;
+  }
+
+  const T * begin() const
+  {
+    return m_Data;
+  }
+
+  const T * end() const
+  {
+    return m_Data + m_Size;
+  }
+
+private:
+  T *         m_Data;
+  std::size_t m_Size;
+};
+
+// the arenas of one filter. A work unit takes a free arena, or makes
+// a new one, for the duration of its DynamicThreadedGenerateData, so
+// there is one per thread in practice.
+class ScratchPool
+{
+public:
+  ScratchPool() :
+    m_Bytes(0), m_Allocations(0)
+  {}
+
+  void Initialize(const std::size_t bytes)
+  {
+    std::lock_guard< std::mutex > lock(m_Mutex);
+    m_Arenas.clear();
+    m_Free.clear();
+    m_Bytes = bytes;
+    m_Allocations = 0;
+  }
+
+  // frees the arenas but keeps the count
+  void Clear()
+  {
+    std::lock_guard< std::mutex > lock(m_Mutex);
+    m_Arenas.clear();
+    m_Free.clear();
+  }
+
+  ScratchArena * Acquire()
+  {
+    std::lock_guard< std::mutex > lock(m_Mutex);
+    if ( m_Free.empty() )
+      {
+      m_Arenas.emplace_back( new ScratchArena(m_Bytes, m_Allocations) );
+      return m_Arenas.back().get();
+      }
+    ScratchArena *arena = m_Free.back();
+    m_Free.pop_back();
+    return arena;
+  }
+
+  void Release(ScratchArena *arena)
+  {
+    std::lock_guard< std::mutex > lock(m_Mutex);
+    m_Free.push_back(arena);
+  }
+
+  SizeValueType GetNumberOfAllocations() const
+  {
+    return m_Allocations;
+  }
+
+  // the space held by the arenas
+  SizeValueType GetNumberOfBytes()
+  {
+    std::lock_guard< std::mutex > lock(m_Mutex);
+    SizeValueType bytes = 0;
+    for ( const auto & arena : m_Arenas )
+      {
+      bytes += arena->GetCapacity();
+      }
+    return bytes;
+  }
+
+private:
+  std::mutex                                   m_Mutex;
+  std::vector< std::unique_ptr< ScratchArena > > m_Arenas;
+  std::vector< ScratchArena * >                m_Free;
+  std::size_t                                  m_Bytes;
+  std::atomic< SizeValueType >                 m_Allocations;
+};
+
+// an arena borrowed from a pool for the lifetime of the lease. It is
+// returned to the state it was lent in.
+class ScratchLease
+{
+public:
+  ScratchLease(ScratchPool & pool) :
+    m_Pool(pool), m_Arena( pool.Acquire() ), m_Mark( m_Arena->GetMark() )
+  {}
+
+  ~ScratchLease()
+  {
+    m_Arena->Release(m_Mark);
+    m_Pool.Release(m_Arena);
+  }
+
+  ScratchArena & GetArena()
+  {
+    return *m_Arena;
+  }
+
+private:
+  ScratchPool &      m_Pool;
+  ScratchArena *     m_Arena;
+  ScratchArena::Mark m_Mark;
+};
+}
+}
+#endif
@@ -0,0 +1,172 @@
+/*=========================================================================
+ *
+ *  Copyright Insight Software Consortium
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+#ifndef itkLabelSetShards_h
+#define itkLabelSetShards_h
+
+#include "itkImageAlgorithm.h"
+#include "itkLabelSetMappedFile.h"
+#include "itkPlatformMultiThreader.h"
+
+#include <cstdio>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#if defined( ITK_LABELSET_MAPPED_FILES )
+#include <sys/wait.h>
+#endif
+
+// Runs a label filter as several processes on one host, each owning a
+// shard of planes along the last axis. A process asks the filter for
+// its shard only, so it reads that shard of the input grown by the
+// halo the filter needs and recomputes the halo itself, rather than
+// exchanging partial results with its neighbours - the passes along
+// the other axes are local to the shard anyway. The shards are
+// written into an output held in a mapped file, which the processes
+// share. Each process has its own address space, so per process
+// memory limits apply to a shard at a time.
+namespace itk
+{
+namespace LabSet
+{
+// shard of shards equal pieces of region, along the last axis
+template< typename TRegion >
+TRegion GetShardRegion(const TRegion & region, const unsigned shard, const unsigned shards)
+{
+  const unsigned       Axis = TRegion::ImageDimension - 1;
+  const SizeValueType  Size = region.GetSize()[Axis];
+  const IndexValueType first = region.GetIndex()[Axis] + static_cast< IndexValueType >( Size * shard / shards );
+  const IndexValueType last = region.GetIndex()[Axis] + static_cast< IndexValueType >( Size * ( shard + 1 ) / shards );
+
+  TRegion piece = region;
+  piece.SetIndex(Axis, first);
+  piece.SetSize( Axis, static_cast< SizeValueType >( last - first ) );
+  return piece;
+}
+
+// Calls work for each of 0 to count - 1 in a child process of its
+// own, and waits for them. True if every one returned 0. Without
+// fork they are called in turn in this process. A child has only the
+// thread that forked it, so work mustn't rely on threads the parent
+// had started, such as those of a thread pool.
+inline bool RunInProcesses(const unsigned count, const std::function< int(unsigned) > & work)
+{
+#if defined( ITK_LABELSET_MAPPED_FILES )
+  std::vector< pid_t > children;
+  bool                 ok = true;
+  std::cout.flush();
+  std::cerr.flush();
+  std::fflush(nullptr);
+  for ( unsigned i = 0; i < count && ok; i++ )
+    {
+    const pid_t child = fork();
+    if ( child == 0 )
+      {
+      int status = 1;
+      try
+        {
+        status = work(i);
+        }
+      catch ( std::exception & e )
+        {
+        std::cerr << "Shard " << i << ": " << e.what() << std::endl;
+        }
+      std::cout.flush();
+      std::cerr.flush();
+      // no destructors or handlers of the parent's objects
+      _exit(status);
+      }
+    ok = ( child > 0 );
+    if ( ok )
+      {
+      children.push_back(child);
+      }
+    }
+  for ( const pid_t child : children )
+    {
+    int status = 0;
+    ok = ( waitpid(child, &status, 0) == child ) && WIFEXITED(status) && WEXITSTATUS(status) == 0 && ok;
+    }
+  return ok;
+#else
+  bool ok = true;
+  for ( unsigned i = 0; i < count; i++ )
+    {
+    ok = ( work(i) == 0 ) && ok;
+    }
+  return ok;
+#endif
+}
+
+// The output of filter for its largest possible region, computed a
+// shard at a time by shards processes. The filter's input needn't
+// have been read - with a reader that streams, each process reads
+// only what its shard needs. Temporary files go in directory, or the
+// default one. Each process runs the filter on a single thread of its
+// own, as the parent's thread pool doesn't survive the fork. The
+// filters upstream still use their own multithreaders, so threaded
+// ones should be updated before calling this.
+template< typename TFilter >
+typename TFilter::OutputImageType::Pointer
+ShardedUpdate(TFilter *filter, const unsigned shards, const std::string & directory = "")
+{
+  using ImageType = typename TFilter::OutputImageType;
+  using RegionType = typename ImageType::RegionType;
+  using ContainerType = MappedImageContainer< SizeValueType, typename ImageType::PixelType >;
+
+  filter->UpdateOutputInformation();
+  const RegionType Largest = filter->GetOutput()->GetLargestPossibleRegion();
+
+  typename ImageType::Pointer output = ImageType::New();
+  output->CopyInformation( filter->GetOutput() );
+  output->SetRegions(Largest);
+  if ( MappedFile::IsSupported() )
+    {
+    typename ContainerType::Pointer container = ContainerType::New();
+    container->SetDirectory(directory);
+    output->SetPixelContainer(container);
+    }
+  output->Allocate();
+
+  const bool ok = RunInProcesses(shards, [&](unsigned shard) -> int
+      {
+      const RegionType Shard = GetShardRegion(Largest, shard, shards);
+      if ( Shard.GetNumberOfPixels() == 0 )
+        {
+        return 0;
+        }
+#if defined( ITK_LABELSET_MAPPED_FILES )
+      filter->SetMultiThreader( PlatformMultiThreader::New() );
+      filter->SetNumberOfWorkUnits(1);
+#endif
+      filter->GetOutput()->SetRequestedRegion(Shard);
+      filter->Update();
+      ImageAlgorithm::Copy(filter->GetOutput(), output.GetPointer(), Shard, Shard);
+      return 0;
+      });
+
+  if ( !ok )
+    {
+    itkGenericExceptionMacro(<< "A shard of " << shards << " failed");
+    }
+  return output;
+}
+}
+}
+#endif
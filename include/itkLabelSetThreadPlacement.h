@@ -0,0 +1,90 @@
+/*=========================================================================
+ *
+ *  Copyright Insight Software Consortium
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+#ifndef itkLabelSetThreadPlacement_h
+#define itkLabelSetThreadPlacement_h
+
+#if defined( __linux__ )
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+// Pins the calling thread to one cpu for as long as it is in scope,
+// and puts its affinity back afterwards. Work unit w goes to the w-th
+// cpu the process may use, wrapping round, so consecutive work units
+// share a socket when the cpus are numbered a socket at a time, as
+// they usually are. Does nothing except on linux.
+namespace itk
+{
+namespace LabSet
+{
+class ThreadPin
+{
+public:
+  ThreadPin(const unsigned workUnit, const bool enabled) :
+    m_Pinned(false)
+  {
+#if defined( __linux__ )
+    if ( !enabled || pthread_getaffinity_np(pthread_self(), sizeof( m_Saved ), &m_Saved) != 0 )
+      {
+      return;
+      }
+    const int Allowed = CPU_COUNT(&m_Saved);
+    if ( Allowed < 2 )
+      {
+      return;
+      }
+    int skip = static_cast< int >( workUnit % static_cast< unsigned >( Allowed ) );
+    for ( int cpu = 0; cpu < CPU_SETSIZE; cpu++ )
+      {
+      if ( CPU_ISSET(cpu, &m_Saved) && skip-- == 0 )
+        {
+        cpu_set_t one;
+        CPU_ZERO(&one);
+        CPU_SET(cpu, &one);
+        m_Pinned = ( pthread_setaffinity_np(pthread_self(), sizeof( one ), &one) == 0 );
+        break;
+        }
+      }
+#else
+    (void)workUnit;
+    (void)enabled;
+#endif
+  }
+
+  ~ThreadPin()
+  {
+#if defined( __linux__ )
+    if ( m_Pinned )
+      {
+      pthread_setaffinity_np(pthread_self(), sizeof( m_Saved ), &m_Saved);
+      }
+#endif
+  }
+
+  ThreadPin(const ThreadPin &) = delete;
+  ThreadPin & operator=(const ThreadPin &) = delete;
+
+private:
+  bool m_Pinned;
+#if defined( __linux__ )
+  cpu_set_t m_Saved;
+#endif
+};
+}
+}
+#endif
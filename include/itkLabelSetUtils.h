@@ -18,16 +18,32 @@
 #ifndef itkLabelSetUtils_h
 #define itkLabelSetUtils_h
 
-#include <itkArray.h>
+#include "itkLabelSetScratchArena.h"
+#include "itkNumericTraits.h"
+
+#include <algorithm>
+#include <cmath>
 
-#include <vector>
 namespace itk
 {
 namespace LabSet
 {
+/** Parabola[k] = magnitude * k * k for 0 <= k < Length. The line
+ * operations look the heights up rather than computing them, so a
+ * compiler targeting FMA has no product to fuse with the subtraction,
+ * and the scalar and lockstep code round the same way. */
+template< class RealType >
+void FillParabola(RealType *Parabola, const int Length, const RealType magnitude)
+{
+  for ( int k = 0; k < Length; k++ )
+    {
+    Parabola[k] = magnitude * k * k;
+    }
+}
+
 template< class LineBufferType, class RealType >
 void DoLineErodeFirstPass(LineBufferType & LineBuf, RealType leftend, RealType rightend,
-                          const RealType magnitude, const RealType Sigma)
+                          const RealType *Parabola, const RealType Sigma)
 {
   // This is the first pass algorithm. We can write down the values
   // because we know the inputs are binary
@@ -40,8 +56,8 @@ void DoLineErodeFirstPass(LineBufferType & LineBuf, RealType leftend, RealType r
     // keep the minimum
     RealType left, right;
     unsigned offset = LineLength - pos;
-    left = leftend - magnitude * ( pos + 1 ) * ( pos + 1 );
-    right = rightend - magnitude * offset * offset;
+    left = leftend - Parabola[pos + 1];
+    right = rightend - Parabola[offset];
     // note hard coded value here - could be a parameter
 //    LineBuf[pos] = std::min(std::min(left, right),
 // itk::NumericTraits<RealType>::One);
@@ -53,7 +69,7 @@ template< class LineBufferType, class LabLineBufferType, class RealType >
 void DoLineDilateFirstPass(LineBufferType & LineBuf, LineBufferType & tmpLineBuf,
                            LabLineBufferType & LabBuf,
                            LabLineBufferType & NewLabBuf,
-                           const RealType magnitude)
+                           const RealType *Parabola)
 {
   // need to propagate the labels here
   const long LineLength = LineBuf.size();
@@ -63,8 +79,7 @@ void DoLineDilateFirstPass(LineBufferType & LineBuf, LineBufferType & tmpLineBuf
   for ( long pos = 0; pos < LineLength; pos++ )
     {
     // left pass
-    RealType krange = pos - lastcontact;
-    RealType thisval = lastval - magnitude * krange * krange;
+    RealType thisval = lastval - Parabola[pos - lastcontact];
 
     if ( LineBuf[pos] >= LineBuf[lastcontact] )
       {
@@ -87,8 +102,7 @@ void DoLineDilateFirstPass(LineBufferType & LineBuf, LineBufferType & tmpLineBuf
   for ( long pos = LineLength - 1; pos >= 0; pos-- )
     {
     // right pass
-    RealType krange = lastcontact - pos;
-    RealType thisval = lastval - magnitude * krange * krange;
+    RealType thisval = lastval - Parabola[lastcontact - pos];
 
     if ( tmpLineBuf[pos] >= tmpLineBuf[lastcontact] )
       {
@@ -111,7 +125,7 @@ void DoLineDilateFirstPass(LineBufferType & LineBuf, LineBufferType & tmpLineBuf
 
 template< class LineBufferType, class RealType, bool doDilate >
 void DoLine(LineBufferType & LineBuf, LineBufferType & tmpLineBuf,
-            const RealType magnitude, const RealType m_Extreme)
+            const RealType *Parabola, const RealType m_Extreme)
 {
   // contact point algorithm
   long koffset = 0, newcontact = 0;  // how far away the search starts.
@@ -126,7 +140,7 @@ void DoLine(LineBufferType & LineBuf, LineBufferType & tmpLineBuf,
     for ( long krange = koffset; krange <= 0; krange++ )
       {
       // difference needs to be paramaterised
-      RealType T = LineBuf[pos + krange] - magnitude * krange * krange;
+      RealType T = LineBuf[pos + krange] - Parabola[-krange];
       // switch on template parameter - hopefully gets optimized away.
       if ( doDilate ? ( T >= BaseVal ) : ( T <= BaseVal ) )
         {
@@ -144,7 +158,7 @@ void DoLine(LineBufferType & LineBuf, LineBufferType & tmpLineBuf,
     auto BaseVal = (RealType)m_Extreme; // the base value for comparison
     for ( long krange = koffset; krange >= 0; krange-- )
       {
-      RealType T = tmpLineBuf[pos + krange] - magnitude * krange * krange;
+      RealType T = tmpLineBuf[pos + krange] - Parabola[krange];
       if ( doDilate ? ( T >= BaseVal ) : ( T <= BaseVal ) )
         {
         BaseVal = T;
@@ -159,7 +173,7 @@ void DoLine(LineBufferType & LineBuf, LineBufferType & tmpLineBuf,
 template< class LineBufferType, class LabBufferType, class RealType, bool doDilate >
 void DoLineLabelProp(LineBufferType & LineBuf, LineBufferType & tmpLineBuf,
                      LabBufferType & LabelBuf, LabBufferType & tmpLabelBuf,
-                     const RealType magnitude, const RealType m_Extreme)
+                     const RealType *Parabola, const RealType m_Extreme)
 {
   // contact point algorithm
   long koffset = 0, newcontact = 0;  // how far away the search starts.
@@ -176,7 +190,7 @@ void DoLineLabelProp(LineBufferType & LineBuf, LineBufferType & tmpLineBuf,
     for ( long krange = koffset; krange <= 0; krange++ )
       {
       // difference needs to be paramaterised
-      RealType T = LineBuf[pos + krange] - magnitude * krange * krange;
+      RealType T = LineBuf[pos + krange] - Parabola[-krange];
       // switch on template parameter - hopefully gets optimized away.
       if ( doDilate ? ( T >= BaseVal ) : ( T <= BaseVal ) )
         {
@@ -199,7 +213,7 @@ void DoLineLabelProp(LineBufferType & LineBuf, LineBufferType & tmpLineBuf,
     LabelType BaseLab = tmpLabelBuf[pos];
     for ( long krange = koffset; krange >= 0; krange-- )
       {
-      RealType T = tmpLineBuf[pos + krange] - magnitude * krange * krange;
+      RealType T = tmpLineBuf[pos + krange] - Parabola[krange];
       if ( doDilate ? ( T >= BaseVal ) : ( T <= BaseVal ) )
         {
         BaseVal = T;
@@ -221,6 +235,147 @@ void DoLineLabelProp(LineBufferType & LineBuf, LineBufferType & tmpLineBuf,
 #endif
 }
 
+template< class SrcBufferType, class DstBufferType, class RealType, bool doDilate >
+void DoLineEnvelopeOneSided(const SrcBufferType & Src, DstBufferType & Dst,
+                            long *Contact,
+                            const long LineLength, const bool forward,
+                            const RealType magnitude, const RealType *Parabola,
+                            ScratchArena & arena)
+{
+  // upper (lower for erosion) envelope of the parabolas centred at
+  // each position, considering only the positions on one side. This
+  // is the Felzenszwalb/Huttenlocher algorithm - the cost doesn't
+  // depend on the size of the parabola. Contact records the position
+  // of the winning parabola.
+  //
+  // The envelope and where each parabola starts to win on it are
+  // computed in double. The value at a position is the winner's, as
+  // DoLine rounds it. Where the winner's neighbours on the envelope
+  // round to the same value, or a better one, the nearest of them is
+  // taken, as DoLine takes it. A parabola off the envelope that is
+  // within rounding of it is not looked at, so the value can differ
+  // from DoLine's by the rounding and the contact can be the other
+  // of two parabolas that are level to within it.
+  ScratchScope            scope(arena);
+  ScratchBuffer< long >   V(arena, LineLength);
+  ScratchBuffer< double > Z(arena, LineLength);
+
+  const double m = magnitude;
+
+  // i counts the positions in the order they are visited
+  auto Position = [&](long i) -> long
+    {
+      return forward ? i : LineLength - 1 - i;
+    };
+  // the value of parabola j at i as DoLine rounds it
+  auto ParabolaVal = [&](long j, long i) -> RealType
+    {
+      return Src[Position(j)] - Parabola[i - j];
+    };
+  auto Better = [](RealType a, RealType b) -> bool
+    {
+      return doDilate ? ( a > b ) : ( a < b );
+    };
+
+  long top = -1;
+  long q = 0;
+
+  for ( long i = 0; i < LineLength; i++ )
+    {
+    // add the parabola centred at i. It wins from s on, and those it
+    // beats from where they would start to win are dropped.
+    const double Si = Src[Position(i)];
+    double       s = -NumericTraits< double >::max();
+    while ( top >= 0 )
+      {
+      const long v = V[top];
+      s = 0.5 * ( ( v + i ) + ( Src[Position(v)] - Si ) / ( m * ( i - v ) ) );
+      if ( s > Z[top] )
+        {
+        break;
+        }
+      --top;
+      s = -NumericTraits< double >::max();
+      }
+    ++top;
+    V[top] = i;
+    Z[top] = s;
+
+    // the parabola winning at i, ties going to the nearest
+    q = std::min(q, top);
+    while ( q < top && Z[q + 1] <= i )
+      {
+      ++q;
+      }
+
+    // the neighbours that round to the same value, or better
+    long     best = q;
+    RealType BaseVal = ParabolaVal(V[q], i);
+    for ( long k = q + 1; k <= top; k++ )
+      {
+      const RealType T = ParabolaVal(V[k], i);
+      if ( Better(BaseVal, T) )
+        {
+        break;
+        }
+      BaseVal = T;
+      best = k;
+      }
+    for ( long k = best - 1; k >= 0; k-- )
+      {
+      const RealType T = ParabolaVal(V[k], i);
+      if ( !Better(T, BaseVal) )
+        {
+        break;
+        }
+      BaseVal = T;
+      best = k;
+      }
+    Dst[Position(i)] = BaseVal;
+    Contact[Position(i)] = Position(V[best]);
+    }
+}
+
+template< class LineBufferType, class RealType, bool doDilate >
+void DoLineEnvelope(LineBufferType & LineBuf, LineBufferType & tmpLineBuf,
+                    const RealType magnitude, const RealType *Parabola, ScratchArena & arena)
+{
+  // linear time alternative to DoLine
+  const long            LineLength = LineBuf.size();
+  ScratchScope          scope(arena);
+  ScratchBuffer< long > Contact(arena, LineLength);
+
+  DoLineEnvelopeOneSided< LineBufferType, LineBufferType, RealType, doDilate >(LineBuf, tmpLineBuf, Contact.begin(),
+                                                                              LineLength, true, magnitude, Parabola, arena);
+  DoLineEnvelopeOneSided< LineBufferType, LineBufferType, RealType, doDilate >(tmpLineBuf, LineBuf, Contact.begin(),
+                                                                              LineLength, false, magnitude, Parabola, arena);
+}
+
+template< class LineBufferType, class LabBufferType, class RealType, bool doDilate >
+void DoLineLabelPropEnvelope(LineBufferType & LineBuf, LineBufferType & tmpLineBuf,
+                             LabBufferType & LabelBuf, LabBufferType & tmpLabelBuf,
+                             const RealType magnitude, const RealType *Parabola, ScratchArena & arena)
+{
+  // linear time alternative to DoLineLabelProp - the label comes
+  // from the winning parabola
+  const long            LineLength = LineBuf.size();
+  ScratchScope          scope(arena);
+  ScratchBuffer< long > Contact(arena, LineLength);
+
+  DoLineEnvelopeOneSided< LineBufferType, LineBufferType, RealType, doDilate >(LineBuf, tmpLineBuf, Contact.begin(),
+                                                                              LineLength, true, magnitude, Parabola, arena);
+  for ( long pos = 0; pos < LineLength; pos++ )
+    {
+    tmpLabelBuf[pos] = LabelBuf[Contact[pos]];
+    }
+  DoLineEnvelopeOneSided< LineBufferType, LineBufferType, RealType, doDilate >(tmpLineBuf, LineBuf, Contact.begin(),
+                                                                              LineLength, false, magnitude, Parabola, arena);
+  for ( long pos = 0; pos < LineLength; pos++ )
+    {
+    LabelBuf[pos] = tmpLabelBuf[Contact[pos]];
+    }
+}
+
 template< class TInIter, class TOutDistIter, class TOutLabIter, class RealType >
 void doOneDimensionErodeFirstPass(TInIter & inputIterator, TOutDistIter & outputIterator,
                                   TOutLabIter & outputLabIterator,
@@ -230,12 +385,14 @@ void doOneDimensionErodeFirstPass(TInIter & inputIterator, TOutDistIter & output
                                   const bool m_UseImageSpacing,
                                   const RealType image_scale,
                                   const RealType Sigma,
-                                  const bool lastpass)
+                                  const bool lastpass,
+                                  ScratchArena & arena)
 {
   // specialised version for binary erosion during first pass. We can
   // compute the results directly because the inputs are flat.
-  using LineBufferType = typename itk::Array< RealType >;
-  using LabelBufferType = typename itk::Array< typename TInIter::PixelType >;
+  using LineBufferType = ScratchBuffer< RealType >;
+  using LabelBufferType = ScratchBuffer< typename TInIter::PixelType >;
+  using EndBufferType = ScratchBuffer< unsigned >;
   RealType iscale = 1.0;
   if ( m_UseImageSpacing )
     {
@@ -245,8 +402,14 @@ void doOneDimensionErodeFirstPass(TInIter & inputIterator, TOutDistIter & output
 //  const RealType magnitude = (m_MagnitudeSign * iscale * iscale)/(2.0 *
 // Sigma);
   const RealType  magnitude = ( m_MagnitudeSign * iscale * iscale ) / ( 2.0 );
-  LineBufferType  LineBuf(LineLength);
-  LabelBufferType LabBuf(LineLength);
+  ScratchScope    scope(arena);
+  LineBufferType  LineBuf(arena, LineLength);
+  LabelBufferType LabBuf(arena, LineLength);
+  LineBufferType  Parabola(arena, LineLength + 1);
+  FillParabola(Parabola.begin(), LineLength + 1, magnitude);
+  // run ends, reused for every line
+  EndBufferType firsts(arena, LineLength);
+  EndBufferType lasts(arena, LineLength);
 
   inputIterator.SetDirection(direction);
   outputIterator.SetDirection(direction);
@@ -261,24 +424,21 @@ void doOneDimensionErodeFirstPass(TInIter & inputIterator, TOutDistIter & output
     // process this direction
     // fetch the line into the buffer - this methodology is like
     // the gaussian filters
-    unsigned int i = 0;
-
-    // copy the scanline to a buffer
-    while ( !inputIterator.IsAtEndOfLine() )
+    inputIterator.Gather( LabBuf.begin() );
+    for ( unsigned i = 0; i < LineLength; i++ )
       {
-      LabBuf[i]      = ( inputIterator.Get() );
       if ( LabBuf[i] )
         {
         LineBuf[i] = 1.0;
         }
-      ++i;
-      ++inputIterator;
+      else
+        {
+        LineBuf[i] = 0;
+        }
       }
     // runlength encode the line buffer (could be integrated with extraction)
 
-    using EndType = std::vector< unsigned >;
-    EndType firsts;
-    EndType lasts;
+    unsigned NumRuns = 0;
 
     for ( unsigned idx = 0; idx < LineLength; idx++ )
       {
@@ -286,7 +446,7 @@ void doOneDimensionErodeFirstPass(TInIter & inputIterator, TOutDistIter & output
       if ( val != 0 )
         {
         // found a run
-        firsts.push_back(idx);
+        firsts[NumRuns] = idx;
         unsigned idxend = idx;
         for (; idxend < LineLength; idxend++ )
           {
@@ -295,51 +455,43 @@ void doOneDimensionErodeFirstPass(TInIter & inputIterator, TOutDistIter & output
             break;
             }
           }
-        lasts.push_back(idxend - 1);
+        lasts[NumRuns++] = idxend - 1;
         idx = idxend - 1;
         }
       }
 
-    for ( unsigned R = 0; R < firsts.size(); R++ )
+    for ( unsigned R = 0; R < NumRuns; R++ )
       {
       unsigned       first = firsts[R];
       unsigned       last = lasts[R];
       unsigned       SLL = last - first + 1;
-      LineBufferType ShortLineBuf(SLL);
+      ScratchScope   runScope(arena);
+      LineBufferType ShortLineBuf(arena, SLL);
       // if one end of the run touches the image edge, then we leave
       // the value as 1
       RealType leftend = 0, rightend = 0;
       if ( first == 0 ) { leftend = Sigma; }
       if ( last == LineLength - 1 ) { rightend = Sigma; }
 
-      DoLineErodeFirstPass< LineBufferType, RealType >(ShortLineBuf, leftend, rightend, magnitude, Sigma);
+      DoLineErodeFirstPass< LineBufferType, RealType >(ShortLineBuf, leftend, rightend, Parabola.begin(), Sigma);
       // copy the segment back into the full line buffer
       std::copy( ShortLineBuf.begin(), ShortLineBuf.end(), &( LineBuf[first] ) );
       }
     // copy the line buffer back to the image
-    unsigned j = 0;
-    while ( !outputIterator.IsAtEndOfLine() )
-      {
-      outputIterator.Set( static_cast< typename TOutDistIter::PixelType >( LineBuf[j++] ) );
-      ++outputIterator;
-      }
+    outputIterator.Scatter( LineBuf.begin() );
 
     if ( lastpass )
       {
       // copy to the output image - this would be a weird case of only
       // using a one dimensional SE
-      unsigned j2 = 0;
-      while ( !outputLabIterator.IsAtEndOfLine() )
+      for ( unsigned j = 0; j < LineLength; j++ )
         {
-        typename TInIter::PixelType val = 0;
-        if ( LineBuf[j2] == Sigma )
+        if ( LineBuf[j] != Sigma )
           {
-          val = LabBuf[j2];
+          LabBuf[j] = 0;
           }
-        outputLabIterator.Set(val);
-        ++outputLabIterator;
-        ++j2;
         }
+      outputLabIterator.Scatter( LabBuf.begin() );
       outputLabIterator.NextLine();
       }
 
@@ -357,12 +509,13 @@ void doOneDimensionDilateFirstPass(TInIter & inputIterator, TOutDistIter & outpu
                                    const int m_MagnitudeSign,
                                    const bool m_UseImageSpacing,
                                    const RealType image_scale,
-                                   const RealType Sigma)
+                                   const RealType Sigma,
+                                   ScratchArena & arena)
 {
   // specialised version for binary erosion during first pass. We can
   // compute the results directly because the inputs are flat.
-  using LineBufferType = typename itk::Array< RealType >;
-  using LabelBufferType = typename itk::Array< typename TInIter::PixelType >;
+  using LineBufferType = ScratchBuffer< RealType >;
+  using LabelBufferType = ScratchBuffer< typename TInIter::PixelType >;
   RealType iscale = 1.0;
   if ( m_UseImageSpacing )
     {
@@ -372,10 +525,13 @@ void doOneDimensionDilateFirstPass(TInIter & inputIterator, TOutDistIter & outpu
   //const RealType magnitude = (m_MagnitudeSign * iscale * iscale)/(2.0 *
   // Sigma);
   const RealType  magnitude = ( m_MagnitudeSign * iscale * iscale ) / ( 2.0 );
-  LineBufferType  LineBuf(LineLength);
-  LabelBufferType LabBuf(LineLength);
-  LineBufferType  tmpLineBuf(LineLength);
-  LabelBufferType newLabBuf(LineLength);
+  ScratchScope    scope(arena);
+  LineBufferType  LineBuf(arena, LineLength);
+  LabelBufferType LabBuf(arena, LineLength);
+  LineBufferType  tmpLineBuf(arena, LineLength);
+  LabelBufferType newLabBuf(arena, LineLength);
+  LineBufferType  Parabola(arena, LineLength);
+  FillParabola(Parabola.begin(), LineLength, magnitude);
 
   inputIterator.SetDirection(direction);
   outputIterator.SetDirection(direction);
@@ -390,12 +546,9 @@ void doOneDimensionDilateFirstPass(TInIter & inputIterator, TOutDistIter & outpu
     // process this direction
     // fetch the line into the buffer - this methodology is like
     // the gaussian filters
-    unsigned int i = 0;
-
-    // copy the scanline to a buffer
-    while ( !inputIterator.IsAtEndOfLine() )
+    inputIterator.Gather( LabBuf.begin() );
+    for ( unsigned i = 0; i < LineLength; i++ )
       {
-      LabBuf[i]      = ( inputIterator.Get() );
       if ( LabBuf[i] )
         {
         LineBuf[i] = Sigma;
@@ -404,25 +557,16 @@ void doOneDimensionDilateFirstPass(TInIter & inputIterator, TOutDistIter & outpu
         {
         LineBuf[i] = 0;
         }
-      ++i;
-      ++inputIterator;
       }
 
     DoLineDilateFirstPass< LineBufferType, LabelBufferType, RealType >(LineBuf,
                                                                        tmpLineBuf,
                                                                        LabBuf,
                                                                        newLabBuf,
-                                                                       magnitude);
+                                                                       Parabola.begin());
     // copy the line buffer back to the image
-    unsigned j = 0;
-    while ( !outputIterator.IsAtEndOfLine() )
-      {
-      outputIterator.Set( static_cast< typename TOutDistIter::PixelType >( LineBuf[j] ) );
-      outputLabIterator.Set(newLabBuf[j]);
-      ++outputLabIterator;
-      ++outputIterator;
-      ++j;
-      }
+    outputIterator.Scatter( LineBuf.begin() );
+    outputLabIterator.Scatter( newLabBuf.begin() );
 
     // now onto the next line
     inputIterator.NextLine();
@@ -442,19 +586,28 @@ void doOneDimensionErode(TInIter & inputIterator, TDistIter & inputDistIterator,
                          const RealType image_scale,
                          const RealType Sigma,
                          const RealType BaseSigma,
-                         const bool lastpass)
+                         const bool lastpass,
+                         const bool useEnvelope,
+                         ScratchArena & arena)
 {
   // traditional erosion - can't optimise the same way as the first pass
-  using LineBufferType = typename itk::Array< RealType >;
-  using LabelBufferType = typename itk::Array< typename TInIter::PixelType >;
+  using LineBufferType = ScratchBuffer< RealType >;
+  using LabelBufferType = ScratchBuffer< typename TInIter::PixelType >;
+  using EndBufferType = ScratchBuffer< unsigned >;
   RealType iscale = 1.0;
   if ( m_UseImageSpacing )
     {
     iscale = image_scale;
     }
   const RealType  magnitude = ( m_MagnitudeSign * iscale * iscale ) / ( 2.0 * Sigma );
-  LineBufferType  LineBuf(LineLength);
-  LabelBufferType LabBuf(LineLength);
+  ScratchScope    scope(arena);
+  LineBufferType  LineBuf(arena, LineLength);
+  LabelBufferType LabBuf(arena, LineLength);
+  LineBufferType  Parabola(arena, LineLength + 2);
+  FillParabola(Parabola.begin(), LineLength + 2, magnitude);
+  // run ends, reused for every line
+  EndBufferType firsts(arena, LineLength);
+  EndBufferType lasts(arena, LineLength);
 
   inputIterator.SetDirection(direction);
   outputDistIterator.SetDirection(direction);
@@ -471,28 +624,17 @@ void doOneDimensionErode(TInIter & inputIterator, TDistIter & inputDistIterator,
     // process this direction
     // fetch the line into the buffer - this methodology is like
     // the gaussian filters
-    unsigned int i = 0;
-
-    // copy the scanline to a buffer
-    while ( !inputIterator.IsAtEndOfLine() )
-      {
-      LineBuf[i] = static_cast< RealType >( inputDistIterator.Get() );
-      LabBuf[i]  = inputIterator.Get();
-      ++i;
-      ++inputDistIterator;
-      ++inputIterator;
-      }
+    inputDistIterator.Gather( LineBuf.begin() );
+    inputIterator.Gather( LabBuf.begin() );
     // runlength encode the line buffer (could be integrated with extraction)
-    using EndType = std::vector< unsigned >;
-    EndType firsts;
-    EndType lasts;
+    unsigned NumRuns = 0;
     for ( unsigned idx = 0; idx < LineLength; idx++ )
       {
       RealType val = LabBuf[idx];
       if ( val != 0 )
         {
         // found a run
-        firsts.push_back(idx);
+        firsts[NumRuns] = idx;
         unsigned idxend = idx;
         for (; idxend < LineLength; idxend++ )
           {
@@ -501,18 +643,19 @@ void doOneDimensionErode(TInIter & inputIterator, TDistIter & inputDistIterator,
             break;
             }
           }
-        lasts.push_back(idxend - 1);
+        lasts[NumRuns++] = idxend - 1;
         idx = idxend - 1;
         }
       }
 
-    for ( unsigned R = 0; R < firsts.size(); R++ )
+    for ( unsigned R = 0; R < NumRuns; R++ )
       {
       unsigned       first = firsts[R];
       unsigned       last = lasts[R];
       unsigned       SLL = last - first + 1;
-      LineBufferType ShortLineBuf(SLL + 2);
-      LineBufferType tmpShortLineBuf(SLL + 2);
+      ScratchScope   runScope(arena);
+      LineBufferType ShortLineBuf(arena, SLL + 2);
+      LineBufferType tmpShortLineBuf(arena, SLL + 2);
 
       // if one end of the run touches the image edge, then we leave
       // the value as 1
@@ -525,33 +668,32 @@ void doOneDimensionErode(TInIter & inputIterator, TDistIter & inputDistIterator,
 
       std::copy( &( LineBuf[first] ), &( LineBuf[last + 1] ), &( ShortLineBuf[1] ) );
 
-      DoLine< LineBufferType, RealType, false >(ShortLineBuf, tmpShortLineBuf, magnitude, m_Extreme);
+      if ( useEnvelope )
+        {
+        DoLineEnvelope< LineBufferType, RealType, false >(ShortLineBuf, tmpShortLineBuf, magnitude, Parabola.begin(),
+                                                          arena);
+        }
+      else
+        {
+        DoLine< LineBufferType, RealType, false >(ShortLineBuf, tmpShortLineBuf, Parabola.begin(), m_Extreme);
+        }
       // copy the segment back into the full line buffer
       std::copy( &( ShortLineBuf[1] ), &( ShortLineBuf[SLL + 1] ), &( LineBuf[first] ) );
       }
     // copy the line buffer back to the image - don't need to do it on
     // the last pass - move when we are sure it is working
-    unsigned j = 0;
-    while ( !outputDistIterator.IsAtEndOfLine() )
-      {
-      outputDistIterator.Set( static_cast< typename TOutDistIter::PixelType >( LineBuf[j++] ) );
-      ++outputDistIterator;
-      }
+    outputDistIterator.Scatter( LineBuf.begin() );
 
     if ( lastpass )
       {
-      unsigned j2 = 0;
-      while ( !outputLabIterator.IsAtEndOfLine() )
+      for ( unsigned j = 0; j < LineLength; j++ )
         {
-        typename TInIter::PixelType val = 0;
-        if ( LineBuf[j2] == BaseSigma )
+        if ( LineBuf[j] != BaseSigma )
           {
-          val = LabBuf[j2];
+          LabBuf[j] = 0;
           }
-        outputLabIterator.Set(val);
-        ++outputLabIterator;
-        ++j2;
         }
+      outputLabIterator.Scatter( LabBuf.begin() );
       outputLabIterator.NextLine();
       }
     // now onto the next line
@@ -570,13 +712,14 @@ void doOneDimensionDilate(TInIter & inputIterator, TDistIter & inputDistIterator
                           const bool m_UseImageSpacing,
                           const RealType m_Extreme,
                           const RealType image_scale,
-                          const RealType Sigma
-                          )
+                          const RealType Sigma,
+                          const bool useEnvelope,
+                          ScratchArena & arena)
 {
   // specialised version for binary erosion during first pass. We can
   // compute the results directly because the inputs are flat.
-  using LineBufferType = typename itk::Array< RealType >;
-  using LabelBufferType = typename itk::Array< typename TInIter::PixelType >;
+  using LineBufferType = ScratchBuffer< RealType >;
+  using LabelBufferType = ScratchBuffer< typename TInIter::PixelType >;
   RealType iscale = 1.0;
   if ( m_UseImageSpacing )
     {
@@ -585,11 +728,13 @@ void doOneDimensionDilate(TInIter & inputIterator, TDistIter & inputDistIterator
   // restructure equation to reduce numerical error
   const RealType magnitude = ( m_MagnitudeSign * iscale * iscale ) / ( 2.0 * Sigma );
 //  const RealType magnitude = (m_MagnitudeSign * iscale * iscale)/(2.0 );
-  LineBufferType  LineBuf(LineLength);
-  LabelBufferType LabBuf(LineLength);
-  LineBufferType  tmpLineBuf(LineLength);
-  LabelBufferType newLabBuf(LineLength);
-  LabelBufferType tmpLabBuf(LineLength);
+  ScratchScope    scope(arena);
+  LineBufferType  LineBuf(arena, LineLength);
+  LabelBufferType LabBuf(arena, LineLength);
+  LineBufferType  tmpLineBuf(arena, LineLength);
+  LabelBufferType tmpLabBuf(arena, LineLength);
+  LineBufferType  Parabola(arena, LineLength);
+  FillParabola(Parabola.begin(), LineLength, magnitude);
 
   inputIterator.SetDirection(direction);
   inputDistIterator.SetDirection(direction);
@@ -606,34 +751,31 @@ void doOneDimensionDilate(TInIter & inputIterator, TDistIter & inputDistIterator
     // process this direction
     // fetch the line into the buffer - this methodology is like
     // the gaussian filters
-    unsigned int i = 0;
+    inputDistIterator.Gather( LineBuf.begin() );
+    inputIterator.Gather( LabBuf.begin() );
 
-    // copy the scanline to a buffer
-    while ( !inputDistIterator.IsAtEndOfLine() )
+    if ( useEnvelope )
       {
-      LineBuf[i] = inputDistIterator.Get();
-      LabBuf[i]  = inputIterator.Get();
-      ++i;
-      ++inputIterator;
-      ++inputDistIterator;
+      DoLineLabelPropEnvelope< LineBufferType, LabelBufferType, RealType, true >(LineBuf,
+                                                                                 tmpLineBuf,
+                                                                                 LabBuf,
+                                                                                 tmpLabBuf,
+                                                                                 magnitude,
+                                                                                 Parabola.begin(),
+                                                                                 arena);
       }
-
-    DoLineLabelProp< LineBufferType, LabelBufferType, RealType, true >(LineBuf,
-                                                                       tmpLineBuf,
-                                                                       LabBuf,
-                                                                       tmpLabBuf,
-                                                                       magnitude,
-                                                                       m_Extreme);
-    // copy the line buffer back to the image
-    unsigned j = 0;
-    while ( !outputDistIterator.IsAtEndOfLine() )
+    else
       {
-      outputDistIterator.Set( static_cast< typename TOutDistIter::PixelType >( LineBuf[j] ) );
-      outputLabIterator.Set(LabBuf[j]);
-      ++outputDistIterator;
-      ++outputLabIterator;
-      j++;
+      DoLineLabelProp< LineBufferType, LabelBufferType, RealType, true >(LineBuf,
+                                                                         tmpLineBuf,
+                                                                         LabBuf,
+                                                                         tmpLabBuf,
+                                                                         Parabola.begin(),
+                                                                         m_Extreme);
       }
+    // copy the line buffer back to the image
+    outputDistIterator.Scatter( LineBuf.begin() );
+    outputLabIterator.Scatter( LabBuf.begin() );
 
     // now onto the next line
     inputIterator.NextLine();
@@ -0,0 +1,149 @@
+#include "tclap/CmdLine.h"
+#include "ioutils.h"
+
+#include "itkLabelSetDilateImageFilter.h"
+#include "itkTimeProbe.h"
+
+// Aidan's trick
+#include <itkSmartPointer.h>
+namespace itk
+{
+template< typename T >
+class Instance:public T::Pointer
+{
+public:
+  Instance():SmartPointer< T >( T::New() ) {}
+};
+}
+
+// Dilates a volume that needn't fit in memory. The input and output
+// should be uncompressed MetaImage (.mha, or .mhd and .raw), which
+// ITK reads and writes a piece at a time, so only a piece of each,
+// grown by the radius, is held. The filter's buffers are in mapped
+// temporary files, in slabs sized to the budget.
+typedef class CmdLineType
+{
+public:
+  std::string InputIm, OutputIm, TempDir;
+  float       radius;
+  int         threads, pieces;
+  double      budget;
+} CmdLineType;
+
+void ParseCmdLine(int argc, char *argv[],
+                  CmdLineType & CmdLineObj
+                  )
+{
+  using namespace TCLAP;
+  try
+  {
+  // Define the command line object.
+  CmdLine cmd("varSize ", ' ', "0.9");
+
+  ValueArg< std::string > inArg("i", "input", "input image (label mask), uncompressed mha", true, "result", "string");
+  cmd.add(inArg);
+
+  ValueArg< std::string > outArg("o", "output", "output image, uncompressed mha", true, "", "string");
+  cmd.add(outArg);
+
+  ValueArg< float > radArg("r", "radius", "dilation radius", true, -1.0, "float");
+  cmd.add(radArg);
+
+  ValueArg< int > threadArg("", "threads", "number of threads", false, 1, "integer");
+  cmd.add(threadArg);
+
+  ValueArg< int > pieceArg("", "pieces", "number of pieces the volume is read and written in", false, 8, "integer");
+  cmd.add(pieceArg);
+
+  ValueArg< double > budgetArg("", "budget", "MB for the filter's slab buffers", false, 256, "float");
+  cmd.add(budgetArg);
+
+  ValueArg< std::string > tmpArg("", "tmpdir", "directory for the mapped files", false, "", "string");
+  cmd.add(tmpArg);
+
+  // Parse the args.
+  cmd.parse(argc, argv);
+
+  CmdLineObj.InputIm = inArg.getValue();
+  CmdLineObj.OutputIm = outArg.getValue();
+  CmdLineObj.radius = radArg.getValue();
+  CmdLineObj.threads = threadArg.getValue();
+  CmdLineObj.pieces = pieceArg.getValue();
+  CmdLineObj.budget = budgetArg.getValue();
+  CmdLineObj.TempDir = tmpArg.getValue();
+  }
+  catch ( ArgException & e )  // catch any exceptions
+    {
+    std::cerr << "error: " << e.error() << " for arg " << e.argId() << std::endl;
+    }
+}
+
+template< class MaskPixType, int dim >
+void doDilate(const CmdLineType & CmdLineObj)
+{
+  using MaskImType = typename itk::Image< MaskPixType, dim >;
+  using FilterType = typename itk::LabelSetDilateImageFilter< MaskImType, MaskImType >;
+  itk::MultiThreader::SetGlobalMaximumNumberOfThreads(CmdLineObj.threads);
+  itk::TimeProbe timer;
+
+  itk::Instance< itk::ImageFileReader< MaskImType > > reader;
+  reader->SetFileName(CmdLineObj.InputIm);
+
+  itk::Instance< FilterType > Dilate;
+  Dilate->SetNumberOfWorkUnits(CmdLineObj.threads);
+  Dilate->SetInput( reader->GetOutput() );
+  Dilate->SetRadius(CmdLineObj.radius);
+  Dilate->SetUseImageSpacing(true);
+  Dilate->SetMemoryPolicy(FilterType::SlabDistanceImage);
+  Dilate->SetMemoryBudget( static_cast< itk::SizeValueType >( CmdLineObj.budget * ( 1 << 20 ) ) );
+  Dilate->SetUseMappedFiles(true);
+  Dilate->SetTemporaryDirectory(CmdLineObj.TempDir);
+
+  itk::Instance< itk::ImageFileWriter< MaskImType > > writer;
+  writer->SetInput( Dilate->GetOutput() );
+  writer->SetFileName(CmdLineObj.OutputIm);
+  writer->SetUseCompression(false);
+  writer->SetNumberOfStreamDivisions(CmdLineObj.pieces);
+
+  std::cout << "lab_dilate_timed,radius,threads,pieces,budget_mb,peak_buffer_mb" << std::endl;
+  timer.Start();
+  writer->Update();
+  timer.Stop();
+  std::cout << std::setprecision(3) << timer.GetMean() << "," << CmdLineObj.radius << "," << CmdLineObj.threads
+            << "," << CmdLineObj.pieces << "," << CmdLineObj.budget << ","
+            << Dilate->GetPeakMemoryBytes() / double( 1 << 20 ) << std::endl;
+}
+
+/////////////////////////////////
+
+int main(int argc, char *argv[])
+{
+  int         dim1;
+  CmdLineType CmdLineObj;
+
+  ParseCmdLine(argc, argv, CmdLineObj);
+
+  itk::ImageIOBase::IOComponentType ComponentType;
+  itk::MultiThreader::SetGlobalMaximumNumberOfThreads(1);
+
+  if ( !readImageInfo(CmdLineObj.InputIm, &ComponentType, &dim1) )
+    {
+    std::cerr << "Failed to open " << CmdLineObj.InputIm << std::endl;
+    return ( EXIT_FAILURE );
+    }
+
+  switch ( dim1 )
+    {
+    case 2:
+      doDilate< unsigned char, 2 >(CmdLineObj);
+      break;
+    case 3:
+      doDilate< unsigned char, 3 >(CmdLineObj);
+      break;
+    default:
+      std::cerr << "Unsupported dimension" << std::endl;
+      return ( EXIT_FAILURE );
+      break;
+    }
+  return EXIT_SUCCESS;
+}
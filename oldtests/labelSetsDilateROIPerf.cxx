@@ -0,0 +1,170 @@
+#include "tclap/CmdLine.h"
+#include "ioutils.h"
+
+#include "itkLabelSetDilateImageFilter.h"
+#include "itkTimeProbe.h"
+
+#include <sstream>
+
+// Aidan's trick
+#include <itkSmartPointer.h>
+namespace itk
+{
+template< typename T >
+class Instance:public T::Pointer
+{
+public:
+  Instance():SmartPointer< T >( T::New() ) {}
+};
+}
+
+// The time to dilate a box in the middle of the image, as a viewer
+// asks for the slice or box it shows after each edit. The boxes are
+// size by size across the first two axes and one plane thick, or
+// size thick with --box.
+typedef class CmdLineType
+{
+public:
+  std::string InputIm, Sizes;
+  float       radius, target;
+  int         repetitions, threads;
+  bool        box;
+} CmdLineType;
+
+void ParseCmdLine(int argc, char *argv[],
+                  CmdLineType & CmdLineObj
+                  )
+{
+  using namespace TCLAP;
+  try
+  {
+  // Define the command line object.
+  CmdLine cmd("varSize ", ' ', "0.9");
+
+  ValueArg< std::string > inArg("i", "input", "input image (label mask)", true, "result", "string");
+  cmd.add(inArg);
+
+  ValueArg< float > radArg("r", "radius", "dilation radius", true, -1.0, "float");
+  cmd.add(radArg);
+
+  ValueArg< std::string > sizeArg("", "sizes", "comma separated box sizes", false, "16,32,64,128,256", "string");
+  cmd.add(sizeArg);
+
+  ValueArg< int > threadArg("", "threads", "number of threads", false, 1, "integer");
+  cmd.add(threadArg);
+
+  ValueArg< int > repArg("", "repetitions", "number of repeats", false, 10, "integer");
+  cmd.add(repArg);
+
+  ValueArg< float > targetArg("", "target", "latency target in ms", false, 50, "float");
+  cmd.add(targetArg);
+
+  SwitchArg boxArg("", "box", "boxes as thick as they are wide", false);
+  cmd.add(boxArg);
+
+  // Parse the args.
+  cmd.parse(argc, argv);
+
+  CmdLineObj.InputIm = inArg.getValue();
+  CmdLineObj.radius = radArg.getValue();
+  CmdLineObj.Sizes = sizeArg.getValue();
+  CmdLineObj.threads = threadArg.getValue();
+  CmdLineObj.repetitions = repArg.getValue();
+  CmdLineObj.target = targetArg.getValue();
+  CmdLineObj.box = boxArg.getValue();
+  }
+  catch ( ArgException & e )  // catch any exceptions
+    {
+    std::cerr << "error: " << e.error() << " for arg " << e.argId() << std::endl;
+    }
+}
+
+template< class MaskPixType, int dim >
+void doDilate(const CmdLineType & CmdLineObj)
+{
+  using MaskImType = typename itk::Image< MaskPixType, dim >;
+  itk::MultiThreader::SetGlobalMaximumNumberOfThreads(CmdLineObj.threads);
+
+  // load
+  typename MaskImType::Pointer mask = readIm< MaskImType >(CmdLineObj.InputIm);
+
+  itk::Instance< itk::LabelSetDilateImageFilter< MaskImType, MaskImType > > Dilate;
+  Dilate->SetNumberOfWorkUnits(CmdLineObj.threads);
+  Dilate->SetInput(mask);
+  Dilate->SetRadius(CmdLineObj.radius);
+  Dilate->SetUseImageSpacing(true);
+
+  const typename MaskImType::RegionType Largest = mask->GetLargestPossibleRegion();
+
+  std::cout << "size,voxels,radius,threads,mean_ms,max_ms,target_met" << std::endl;
+  std::stringstream sizes(CmdLineObj.Sizes);
+  std::string       item;
+  while ( std::getline(sizes, item, ',') )
+    {
+    const itk::SizeValueType size = std::stoul(item);
+
+    // centred, and within the image
+    typename MaskImType::RegionType roi = Largest;
+    for ( unsigned P = 0; P < dim; P++ )
+      {
+      const itk::SizeValueType extent = Largest.GetSize()[P];
+      const itk::SizeValueType wanted = ( P < 2 || CmdLineObj.box ) ? size : 1;
+      roi.SetSize( P, std::min(wanted, extent) );
+      roi.SetIndex( P, Largest.GetIndex()[P] + static_cast< itk::IndexValueType >( ( extent - roi.GetSize()[P] ) / 2 ) );
+      }
+
+    itk::TimeProbe timer;
+    double         worst = 0;
+    for ( int r = 0; r < CmdLineObj.repetitions; r++ )
+      {
+      // as after an edit
+      Dilate->Modified();
+      itk::TimeProbe once;
+      timer.Start();
+      once.Start();
+      Dilate->GetOutput()->SetRequestedRegion(roi);
+      Dilate->Update();
+      once.Stop();
+      timer.Stop();
+      worst = std::max( worst, once.GetTotal() );
+      }
+    const double mean = 1000 * timer.GetMean();
+    std::cout << std::setprecision(3) << size << "," << roi.GetNumberOfPixels() << "," << CmdLineObj.radius << ","
+              << CmdLineObj.threads << "," << mean << "," << 1000 * worst << ","
+              << ( 1000 * worst <= CmdLineObj.target ) << std::endl;
+    }
+}
+
+/////////////////////////////////
+
+int main(int argc, char *argv[])
+{
+  int         dim1;
+  CmdLineType CmdLineObj;
+
+  ParseCmdLine(argc, argv, CmdLineObj);
+
+  itk::ImageIOBase::IOComponentType ComponentType;
+  itk::MultiThreader::SetGlobalMaximumNumberOfThreads(1);
+
+  if ( !readImageInfo(CmdLineObj.InputIm, &ComponentType, &dim1) )
+    {
+    std::cerr << "Failed to open " << CmdLineObj.InputIm << std::endl;
+    return ( EXIT_FAILURE );
+    }
+
+  switch ( dim1 )
+    {
+    case 2:
+      doDilate< unsigned char, 2 >(CmdLineObj);
+      break;
+    case 3:
+      doDilate< unsigned char, 3 >(CmdLineObj);
+      break;
+    default:
+      std::cerr << "Unsupported dimension" << std::endl;
+      return ( EXIT_FAILURE );
+      break;
+    }
+  return EXIT_SUCCESS;
+}
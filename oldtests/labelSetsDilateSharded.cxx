@@ -0,0 +1,136 @@
+#include "tclap/CmdLine.h"
+#include "ioutils.h"
+
+#include "itkLabelSetDilateImageFilter.h"
+#include "itkLabelSetShards.h"
+#include "itkTimeProbe.h"
+
+// Aidan's trick
+#include <itkSmartPointer.h>
+namespace itk
+{
+template< typename T >
+class Instance:public T::Pointer
+{
+public:
+  Instance():SmartPointer< T >( T::New() ) {}
+};
+}
+
+// Dilates a volume with several processes, each producing a shard of
+// planes along the last axis with its own threads. With an
+// uncompressed MetaImage input (.mha, or .mhd and .raw) each process
+// reads only its shard and the planes within reach of it.
+typedef class CmdLineType
+{
+public:
+  std::string InputIm, OutputIm, TempDir;
+  float       radius;
+  int         threads, shards;
+} CmdLineType;
+
+void ParseCmdLine(int argc, char *argv[],
+                  CmdLineType & CmdLineObj
+                  )
+{
+  using namespace TCLAP;
+  try
+  {
+  // Define the command line object.
+  CmdLine cmd("varSize ", ' ', "0.9");
+
+  ValueArg< std::string > inArg("i", "input", "input image (label mask)", true, "result", "string");
+  cmd.add(inArg);
+
+  ValueArg< std::string > outArg("o", "output", "output image", true, "", "string");
+  cmd.add(outArg);
+
+  ValueArg< float > radArg("r", "radius", "dilation radius", true, -1.0, "float");
+  cmd.add(radArg);
+
+  ValueArg< int > threadArg("", "threads", "number of threads in each process", false, 1, "integer");
+  cmd.add(threadArg);
+
+  ValueArg< int > shardArg("", "shards", "number of processes", false, 2, "integer");
+  cmd.add(shardArg);
+
+  ValueArg< std::string > tmpArg("", "tmpdir", "directory for the shared output file", false, "", "string");
+  cmd.add(tmpArg);
+
+  // Parse the args.
+  cmd.parse(argc, argv);
+
+  CmdLineObj.InputIm = inArg.getValue();
+  CmdLineObj.OutputIm = outArg.getValue();
+  CmdLineObj.radius = radArg.getValue();
+  CmdLineObj.threads = threadArg.getValue();
+  CmdLineObj.shards = shardArg.getValue();
+  CmdLineObj.TempDir = tmpArg.getValue();
+  }
+  catch ( ArgException & e )  // catch any exceptions
+    {
+    std::cerr << "error: " << e.error() << " for arg " << e.argId() << std::endl;
+    }
+}
+
+template< class MaskPixType, int dim >
+void doDilate(const CmdLineType & CmdLineObj)
+{
+  using MaskImType = typename itk::Image< MaskPixType, dim >;
+  using FilterType = typename itk::LabelSetDilateImageFilter< MaskImType, MaskImType >;
+  itk::MultiThreader::SetGlobalMaximumNumberOfThreads(CmdLineObj.threads);
+  itk::TimeProbe timer;
+
+  itk::Instance< itk::ImageFileReader< MaskImType > > reader;
+  reader->SetFileName(CmdLineObj.InputIm);
+
+  itk::Instance< FilterType > Dilate;
+  Dilate->SetNumberOfWorkUnits(CmdLineObj.threads);
+  Dilate->SetInput( reader->GetOutput() );
+  Dilate->SetRadius(CmdLineObj.radius);
+  Dilate->SetUseImageSpacing(true);
+  Dilate->SetMemoryPolicy(FilterType::ReleaseDistanceImage);
+
+  std::cout << "lab_dilate_timed,radius,threads,shards" << std::endl;
+  timer.Start();
+  typename MaskImType::Pointer result = itk::LabSet::ShardedUpdate(Dilate.GetPointer(), CmdLineObj.shards,
+                                                                   CmdLineObj.TempDir);
+  timer.Stop();
+  std::cout << std::setprecision(3) << timer.GetMean() << "," << CmdLineObj.radius << "," << CmdLineObj.threads
+            << "," << CmdLineObj.shards << std::endl;
+  writeIm< MaskImType >(result, CmdLineObj.OutputIm);
+}
+
+/////////////////////////////////
+
+int main(int argc, char *argv[])
+{
+  int         dim1;
+  CmdLineType CmdLineObj;
+
+  ParseCmdLine(argc, argv, CmdLineObj);
+
+  itk::ImageIOBase::IOComponentType ComponentType;
+  itk::MultiThreader::SetGlobalMaximumNumberOfThreads(1);
+
+  if ( !readImageInfo(CmdLineObj.InputIm, &ComponentType, &dim1) )
+    {
+    std::cerr << "Failed to open " << CmdLineObj.InputIm << std::endl;
+    return ( EXIT_FAILURE );
+    }
+
+  switch ( dim1 )
+    {
+    case 2:
+      doDilate< unsigned char, 2 >(CmdLineObj);
+      break;
+    case 3:
+      doDilate< unsigned char, 3 >(CmdLineObj);
+      break;
+    default:
+      std::cerr << "Unsupported dimension" << std::endl;
+      return ( EXIT_FAILURE );
+      break;
+    }
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,129 @@
+/*=========================================================================
+ *
+ *  Copyright Insight Software Consortium
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include "itkLabelSetBlockScheduler.h"
+
+// BlockScheduler::Take from several threads at once. Every block must
+// be handed out exactly once, whoever ends up with it.
+namespace
+{
+// workers 0 .. active - 1 take blocks until there are none left, and
+// count how often each block was handed out
+bool takeAll(itk::LabSet::BlockScheduler & scheduler, const unsigned active, const itk::SizeValueType blocks)
+{
+  std::vector< std::vector< itk::SizeValueType > > taken(active);
+  std::vector< std::thread >                       threads;
+  for ( unsigned w = 0; w < active; w++ )
+    {
+    threads.emplace_back([&scheduler, &taken, w]()
+                           {
+                           itk::SizeValueType block;
+                           while ( scheduler.Take(w, block) )
+                             {
+                             taken[w].push_back(block);
+                             }
+                           });
+    }
+  for ( auto & t : threads )
+    {
+    t.join();
+    }
+
+  std::vector< unsigned > count(blocks, 0);
+  for ( const auto & blocksOfWorker : taken )
+    {
+    for ( const itk::SizeValueType b : blocksOfWorker )
+      {
+      if ( b >= blocks )
+        {
+        std::cerr << "Block " << b << " out of range" << std::endl;
+        return false;
+        }
+      ++count[b];
+      }
+    }
+  for ( itk::SizeValueType b = 0; b < blocks; b++ )
+    {
+    if ( count[b] != 1 )
+      {
+      std::cerr << "Block " << b << " handed out " << count[b] << " times" << std::endl;
+      return false;
+      }
+    }
+  return true;
+}
+}
+
+int itkLabelSetBlockSchedulerTest(int, char *[])
+{
+  const unsigned           Workers = 8;
+  const itk::SizeValueType Blocks = 20000;
+
+  itk::LabSet::BlockScheduler scheduler;
+  const std::vector< double > equal;
+
+  // all workers, many times, so the steals race with each other and
+  // with the owners taking from the front
+  for ( unsigned trial = 0; trial < 50; trial++ )
+    {
+    scheduler.Initialize(Workers, Blocks, equal);
+    if ( !takeAll(scheduler, Workers, Blocks) )
+      {
+      return EXIT_FAILURE;
+      }
+    }
+
+  // the last worker never turns up, so its share has to be stolen
+  scheduler.Initialize(Workers, Blocks, equal);
+  if ( !takeAll(scheduler, Workers - 1, Blocks) )
+    {
+    return EXIT_FAILURE;
+    }
+  if ( scheduler.GetNumberOfSteals() == 0 )
+    {
+    std::cerr << "The absent worker's blocks weren't stolen" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  // unequal costs, the first blocks being the dearest, give the first
+  // worker fewer blocks than the last
+  std::vector< double > cost(Blocks);
+  for ( itk::SizeValueType b = 0; b < Blocks; b++ )
+    {
+    cost[b] = ( b < Blocks / 4 ) ? 10.0 : 1.0;
+    }
+  scheduler.Initialize(Workers, Blocks, cost);
+  itk::SizeValueType firstBegin, firstEnd, lastBegin, lastEnd;
+  scheduler.GetRange(0, firstBegin, firstEnd);
+  scheduler.GetRange(Workers - 1, lastBegin, lastEnd);
+  if ( firstEnd - firstBegin >= lastEnd - lastBegin || lastEnd != Blocks )
+    {
+    std::cerr << "Shares don't follow the cost: " << firstEnd - firstBegin << " and " << lastEnd - lastBegin
+              << std::endl;
+    return EXIT_FAILURE;
+    }
+  if ( !takeAll(scheduler, Workers, Blocks) )
+    {
+    return EXIT_FAILURE;
+    }
+
+  return EXIT_SUCCESS;
+}
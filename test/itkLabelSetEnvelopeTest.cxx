@@ -0,0 +1,316 @@
+/*=========================================================================
+ *
+ *  Copyright Insight Software Consortium
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+#include <atomic>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include "itkNumericTraits.h"
+#include "itkImageRegionConstIterator.h"
+#include "itkLabelSetUtils.h"
+#include "itkLabelSetDilateImageFilter.h"
+
+// The envelope algorithm and the contact point algorithm against the
+// exact answer, worked out the slow way in double. Both round, so a
+// value is right if it is within rounding of the best one and a label
+// is right if it belongs to a parabola that is. Short lines are random,
+// drawn from a handful of values so there are plenty of ties, or runs
+// of parabolas like the output of an earlier pass. Long lines have
+// sparse seeds and a fine spacing, so parabolas reach a long way and
+// overlap many others.
+namespace
+{
+using RealType = float;
+using LabelType = unsigned char;
+using LineType = itk::LabSet::ScratchBuffer< RealType >;
+using LabLineType = itk::LabSet::ScratchBuffer< LabelType >;
+
+bool sameBits(const RealType a, const RealType b)
+{
+  return std::memcmp( &a, &b, sizeof( RealType ) ) == 0;
+}
+
+// Seeds are the positions whose parabolas can win away from
+// themselves. The others are all the same height and only win at
+// themselves.
+struct LineDesc {
+  std::vector< RealType >  Height;
+  std::vector< LabelType > Label;
+  std::vector< long >      Seeds;
+  RealType                 magnitude;
+};
+
+template< bool doDilate >
+int checkAgainstExact(const LineDesc & desc, const LineType & Line, const LabLineType & Lab,
+                      const bool checkLabels)
+{
+  const long   LineLength = desc.Height.size();
+  const double m = desc.magnitude;
+
+  double MaxHeight = 0;
+  for ( long pos = 0; pos < LineLength; pos++ )
+    {
+    MaxHeight = std::max( MaxHeight, std::abs( static_cast< double >( desc.Height[pos] ) ) );
+    }
+
+  int failures = 0;
+  for ( long pos = 0; pos < LineLength; pos++ )
+    {
+    auto Exact = [&](long j) -> double
+      {
+      return static_cast< double >( desc.Height[j] ) - m * ( pos - j ) * ( pos - j );
+      };
+    double Best = Exact(pos);
+    for ( const long j : desc.Seeds )
+      {
+      Best = doDilate ? std::max( Best, Exact(j) ) : std::min( Best, Exact(j) );
+      }
+    // a height and a parabola each round once per pass
+    const double tol = 8 * itk::NumericTraits< RealType >::epsilon() * ( 2 * MaxHeight + std::abs(Best) );
+    bool         ok = std::abs(Line[pos] - Best) <= tol;
+    if ( ok && checkLabels )
+      {
+      ok = std::abs(Exact(pos) - Best) <= tol && desc.Label[pos] == Lab[pos];
+      for ( const long j : desc.Seeds )
+        {
+        ok = ok || ( std::abs(Exact(j) - Best) <= tol && desc.Label[j] == Lab[pos] );
+        }
+      }
+    failures += !ok;
+    }
+  return failures;
+}
+
+// runs both algorithms on a line, checks them against the exact answer
+// and, if bitForBit is set, against each other
+template< bool doDilate >
+int checkLine(const LineDesc & desc, const bool bitForBit, itk::LabSet::ScratchArena & arena)
+{
+  itk::LabSet::ScratchScope scope(arena);
+
+  const long     LineLength = desc.Height.size();
+  const RealType magnitude = desc.magnitude;
+  const RealType m_Extreme = doDilate ? itk::NumericTraits< RealType >::NonpositiveMin()
+                                      : itk::NumericTraits< RealType >::max();
+
+  LineType    Parabola(arena, LineLength);
+  LineType    Line(arena, LineLength), tmpLine(arena, LineLength);
+  LineType    Envelope(arena, LineLength), tmpEnvelope(arena, LineLength);
+  LabLineType Lab(arena, LineLength), tmpLab(arena, LineLength);
+  LabLineType EnvelopeLab(arena, LineLength), tmpEnvelopeLab(arena, LineLength);
+
+  for ( long pos = 0; pos < LineLength; pos++ )
+    {
+    Line[pos] = Envelope[pos] = desc.Height[pos];
+    Lab[pos] = EnvelopeLab[pos] = desc.Label[pos];
+    }
+
+  itk::LabSet::FillParabola(&( Parabola[0] ), LineLength, magnitude);
+  if ( doDilate )
+    {
+    itk::LabSet::DoLineLabelProp< LineType, LabLineType, RealType, doDilate >(Line, tmpLine, Lab, tmpLab,
+                                                                              &( Parabola[0] ), m_Extreme);
+    itk::LabSet::DoLineLabelPropEnvelope< LineType, LabLineType, RealType, doDilate >(Envelope, tmpEnvelope,
+                                                                                      EnvelopeLab, tmpEnvelopeLab,
+                                                                                      magnitude, &( Parabola[0] ),
+                                                                                      arena);
+    }
+  else
+    {
+    itk::LabSet::DoLine< LineType, RealType, doDilate >(Line, tmpLine, &( Parabola[0] ), m_Extreme);
+    itk::LabSet::DoLineEnvelope< LineType, RealType, doDilate >(Envelope, tmpEnvelope, magnitude, &( Parabola[0] ),
+                                                                arena);
+    }
+
+  int failures = checkAgainstExact< doDilate >(desc, Line, Lab, doDilate)
+                 + checkAgainstExact< doDilate >(desc, Envelope, EnvelopeLab, doDilate);
+  if ( bitForBit )
+    {
+    for ( long pos = 0; pos < LineLength; pos++ )
+      {
+      if ( !sameBits(Line[pos], Envelope[pos]) || ( doDilate && Lab[pos] != EnvelopeLab[pos] ) )
+        {
+        ++failures;
+        }
+      }
+    }
+  return failures;
+}
+
+template< bool doDilate >
+LineDesc shortLine(std::mt19937 & rng)
+{
+  std::uniform_int_distribution< int >       length(1, 200);
+  std::uniform_int_distribution< int >       kind(0, 2);
+  std::uniform_int_distribution< int >       label(0, 3);
+  std::uniform_int_distribution< int >       level(0, 3);
+  std::uniform_real_distribution< RealType > value(0, 100);
+  std::uniform_real_distribution< RealType > spacing(0.1f, 3.0f);
+
+  LineDesc       desc;
+  const long     LineLength = length(rng);
+  const RealType Sigma = value(rng) + 1;
+  const RealType iscale = spacing(rng);
+  desc.magnitude = ( doDilate ? 1 : -1 ) * iscale * iscale / ( 2 * Sigma );
+
+  const int how = kind(rng);
+  for ( long pos = 0; pos < LineLength; pos++ )
+    {
+    RealType h;
+    if ( how == 0 )
+      {
+      h = value(rng);
+      }
+    else if ( how == 1 )
+      {
+      h = 25 * level(rng);
+      }
+    else
+      {
+      // parabolas of a few labels, as left by the first pass
+      const long k = pos % 17;
+      h = Sigma - std::abs(desc.magnitude) * k * k;
+      }
+    desc.Height.push_back(h);
+    desc.Label.push_back( label(rng) );
+    desc.Seeds.push_back(pos);
+    }
+  return desc;
+}
+
+// seeds of height r * r / 2 at the given gaps on a flat line, for a
+// radius r in physical units - the dilation, and the erosion of the
+// inverted line
+template< bool doDilate >
+LineDesc seededLine(const long LineLength, const std::vector< long > & gaps, const double r,
+                    const double spacing, std::mt19937 & rng)
+{
+  std::uniform_int_distribution< int > label(1, 255);
+
+  LineDesc       desc;
+  const RealType Sigma = r * r / 2;
+  desc.magnitude = ( doDilate ? 1 : -1 ) * spacing * spacing / 2;
+  desc.Height.assign(LineLength, doDilate ? 0 : Sigma);
+  desc.Label.assign(LineLength, 0);
+  long pos = 0;
+  for ( unsigned k = 0; pos < LineLength; pos += gaps[k++ % gaps.size()] )
+    {
+    desc.Height[pos] = doDilate ? Sigma : 0;
+    desc.Label[pos] = label(rng);
+    desc.Seeds.push_back(pos);
+    }
+  return desc;
+}
+
+template< bool doDilate >
+int checkLongLines(std::mt19937 & rng, itk::LabSet::ScratchArena & arena)
+{
+  std::uniform_int_distribution< long >  length(3000, 6000);
+  std::uniform_int_distribution< long >  gap(1, 2000);
+  std::uniform_real_distribution< double > radius(80, 120);
+  std::uniform_real_distribution< double > spacing(0.02, 0.1);
+
+  int failures = 0;
+  // the cases that broke an earlier version - the walk stopped short
+  // of the winner
+  failures += checkLine< doDilate >(seededLine< doDilate >(6000, { 400 }, 80, 0.05, rng), true, arena);
+  failures += checkLine< doDilate >(seededLine< doDilate >(6000, { 1999 }, 80, 0.1, rng), true, arena);
+  for ( unsigned trial = 0; trial < 20; trial++ )
+    {
+    std::vector< long > gaps;
+    for ( unsigned k = 0; k < 16; k++ )
+      {
+      gaps.push_back( gap(rng) );
+      }
+    failures += checkLine< doDilate >(seededLine< doDilate >(length(rng), gaps, radius(rng), spacing(rng), rng),
+                                      false, arena);
+    }
+  return failures;
+}
+
+// the whole filter on a long thin image, seeds along the long axis so
+// the envelope runs on long lines, against the contact point algorithm
+int checkFilter(const long gap, const double spacing)
+{
+  using ImageType = itk::Image< LabelType, 2 >;
+  using FilterType = itk::LabelSetDilateImageFilter< ImageType, ImageType >;
+
+  ImageType::Pointer   input = ImageType::New();
+  ImageType::SizeType  size = { { 3, 6000 } };
+  ImageType::RegionType region;
+  region.SetSize(size);
+  input->SetRegions(region);
+  ImageType::SpacingType sp;
+  sp.Fill(spacing);
+  input->SetSpacing(sp);
+  input->Allocate();
+  input->FillBuffer(0);
+  for ( long y = 0, k = 0; y < 6000; y += gap, k++ )
+    {
+    ImageType::IndexType idx = { { 1, y } };
+    input->SetPixel( idx, 1 + k % 3 );
+    }
+
+  FilterType::Pointer filters[2];
+  for ( unsigned useEnvelope = 0; useEnvelope < 2; useEnvelope++ )
+    {
+    filters[useEnvelope] = FilterType::New();
+    filters[useEnvelope]->SetInput(input);
+    filters[useEnvelope]->SetRadius(80);
+    filters[useEnvelope]->SetUseImageSpacing(true);
+    filters[useEnvelope]->SetUseEnvelopeAlgorithm(useEnvelope);
+    filters[useEnvelope]->Update();
+    }
+
+  int failures = 0;
+  itk::ImageRegionConstIterator< ImageType > contact(filters[0]->GetOutput(), region);
+  itk::ImageRegionConstIterator< ImageType > envelope(filters[1]->GetOutput(), region);
+  for (; !contact.IsAtEnd(); ++contact, ++envelope )
+    {
+    failures += contact.Get() != envelope.Get();
+    }
+  return failures;
+}
+}
+
+int itkLabelSetEnvelopeTest(int, char *[])
+{
+  std::atomic< itk::SizeValueType > allocations(0);
+  itk::LabSet::ScratchArena         arena(1 << 20, allocations);
+  std::mt19937                      rng(4321);
+
+  int failures = 0;
+  int lines = 0;
+  for ( unsigned trial = 0; trial < 20000; trial++ )
+    {
+    const int dilate = checkLine< true >(shortLine< true >(rng), false, arena);
+    const int erode = checkLine< false >(shortLine< false >(rng), false, arena);
+    lines += ( dilate > 0 ) + ( erode > 0 );
+    failures += dilate + erode;
+    }
+  std::cout << failures << " wrong on " << lines << " short lines" << std::endl;
+
+  const int longFailures = checkLongLines< true >(rng, arena) + checkLongLines< false >(rng, arena);
+  std::cout << longFailures << " wrong on long lines" << std::endl;
+
+  const int filterFailures = checkFilter(400, 0.05) + checkFilter(1999, 0.1);
+  std::cout << filterFailures << " differences between the filter outputs" << std::endl;
+
+  return ( failures || longFailures || filterFailures ) ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,153 @@
+/*=========================================================================
+ *
+ *  Copyright Insight Software Consortium
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+#include <cstring>
+#include <iostream>
+#include <random>
+
+#include "itkLabelSetLaneUtils.h"
+
+// The lockstep first pass kernels against the scalar first passes on
+// random lines, bit for bit. The magnitudes are not exactly representable,
+// so a fused multiply-subtract in either shows up here - build with
+// the cpu's own instruction set to check the scalar code.
+namespace
+{
+using RealType = float;
+using LabelType = unsigned char;
+using LineType = itk::LabSet::ScratchBuffer< RealType >;
+using LabLineType = itk::LabSet::ScratchBuffer< LabelType >;
+
+bool sameBits(const RealType a, const RealType b)
+{
+  return std::memcmp( &a, &b, sizeof( RealType ) ) == 0;
+}
+
+int checkFirstPass(const unsigned Lanes, std::mt19937 & rng, itk::LabSet::ScratchArena & arena)
+{
+  itk::LabSet::ScratchScope scope(arena);
+
+  const int      LineLength = 57;
+  const RealType Sigma = 7.3f;
+  const RealType magnitude = 0.7f * 0.7f / 2.0f;
+
+  std::uniform_int_distribution< int >      label(0, 2);
+  std::uniform_real_distribution< RealType > value(0, Sigma);
+
+  LineType    LineBuf(arena, Lanes * LineLength), tmpLineBuf(arena, Lanes * LineLength);
+  LabLineType LabBuf(arena, Lanes * LineLength), NewLabBuf(arena, Lanes * LineLength);
+  LineType    Parabola(arena, LineLength + 1), NegParabola(arena, LineLength + 1);
+  itk::LabSet::FillParabola(&( Parabola[0] ), LineLength + 1, magnitude);
+  itk::LabSet::FillParabola(&( NegParabola[0] ), LineLength + 1, -magnitude);
+
+  for ( unsigned l = 0; l < Lanes; l++ )
+    {
+    for ( int pos = 0; pos < LineLength; pos++ )
+      {
+      LabBuf[pos * Lanes + l] = label(rng);
+      LineBuf[pos * Lanes + l] = LabBuf[pos * Lanes + l] ? value(rng) : 0;
+      }
+    }
+
+  int failures = 0;
+
+  // erosion, run by run as doOneDimensionErodeFirstPass does it
+  itk::LabSet::RunLanes< itk::LabSet::ErodeFirstPassLanesKernel< RealType, LabelType > >(
+    Lanes, &( tmpLineBuf[0] ), static_cast< const LabelType * >( &( LabBuf[0] ) ), LineLength,
+    static_cast< const RealType * >( &( NegParabola[0] ) ), Sigma);
+  for ( unsigned l = 0; l < Lanes; l++ )
+    {
+    for ( int first = 0; first < LineLength; )
+      {
+      const LabelType lab = LabBuf[first * Lanes + l];
+      int             last = first;
+      while ( last + 1 < LineLength && LabBuf[( last + 1 ) * Lanes + l] == lab )
+        {
+        ++last;
+        }
+      itk::LabSet::ScratchScope run(arena);
+      LineType                  Run(arena, last - first + 1);
+      if ( lab != 0 )
+        {
+        itk::LabSet::DoLineErodeFirstPass< LineType, RealType >(Run, ( first == 0 ) ? Sigma : 0,
+                                                                ( last == LineLength - 1 ) ? Sigma : 0,
+                                                                &( NegParabola[0] ), Sigma);
+        }
+      for ( int pos = first; pos <= last; pos++ )
+        {
+        const RealType expected = ( lab != 0 ) ? Run[pos - first] : 0;
+        failures += !sameBits(tmpLineBuf[pos * Lanes + l], expected);
+        }
+      first = last + 1;
+      }
+    }
+
+  // dilation
+  LineType    Expected(arena, Lanes * LineLength);
+  LabLineType ExpectedLab(arena, Lanes * LineLength);
+  for ( unsigned l = 0; l < Lanes; l++ )
+    {
+    itk::LabSet::ScratchScope lane(arena);
+    LineType                  Line(arena, LineLength), tmpLine(arena, LineLength);
+    LabLineType               Lab(arena, LineLength), NewLab(arena, LineLength);
+    for ( int pos = 0; pos < LineLength; pos++ )
+      {
+      Line[pos] = LineBuf[pos * Lanes + l];
+      Lab[pos] = LabBuf[pos * Lanes + l];
+      }
+    itk::LabSet::DoLineDilateFirstPass(Line, tmpLine, Lab, NewLab, &( Parabola[0] ));
+    for ( int pos = 0; pos < LineLength; pos++ )
+      {
+      Expected[pos * Lanes + l] = Line[pos];
+      ExpectedLab[pos * Lanes + l] = NewLab[pos];
+      }
+    }
+  itk::LabSet::RunLanes< itk::LabSet::DilateFirstPassLanesKernel< RealType, LabelType > >(
+    Lanes, &( LineBuf[0] ), &( tmpLineBuf[0] ), static_cast< const LabelType * >( &( LabBuf[0] ) ),
+    &( NewLabBuf[0] ), LineLength, static_cast< const RealType * >( &( Parabola[0] ) ));
+  for ( int i = 0; i < static_cast< int >( Lanes ) * LineLength; i++ )
+    {
+    failures += !sameBits(LineBuf[i], Expected[i]) || NewLabBuf[i] != ExpectedLab[i];
+    }
+  return failures;
+}
+}
+
+int itkLabelSetLanesTest(int, char *[])
+{
+  const unsigned Available = itk::LabSet::GetNumberOfLanes();
+  if ( Available == 0 )
+    {
+    std::cout << "No lockstep kernels on this cpu" << std::endl;
+    return EXIT_SUCCESS;
+    }
+
+  std::atomic< itk::SizeValueType > allocations(0);
+  itk::LabSet::ScratchArena         arena(1 << 20, allocations);
+  std::mt19937                      rng(1234);
+
+  int failures = 0;
+  for ( unsigned Lanes = 8; Lanes <= Available; Lanes *= 2 )
+    {
+    for ( unsigned trial = 0; trial < 200; trial++ )
+      {
+      failures += checkFirstPass(Lanes, rng, arena);
+      }
+    std::cout << Lanes << " lanes, " << failures << " differences" << std::endl;
+    }
+  return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,178 @@
+/*=========================================================================
+ *
+ *  Copyright Insight Software Consortium
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+#include <cstring>
+#include <iostream>
+#include <random>
+
+#include "itkLabelSetLaneUtils.h"
+
+// The lockstep contact point kernel against DoLine/DoLineLabelProp on
+// random lines of different lengths, bit for bit. The magnitudes are
+// not exactly representable, so a fused multiply-subtract in either
+// shows up here. The dilation passes leave flat lines out of the
+// lanes, which relies on them coming through unchanged; that is
+// checked too.
+namespace
+{
+using RealType = float;
+using LabelType = unsigned char;
+using LineType = itk::LabSet::ScratchBuffer< RealType >;
+using LabLineType = itk::LabSet::ScratchBuffer< LabelType >;
+
+bool sameBits(const RealType a, const RealType b)
+{
+  return std::memcmp( &a, &b, sizeof( RealType ) ) == 0;
+}
+
+template< bool doDilate >
+int checkLine(const unsigned Lanes, std::mt19937 & rng, itk::LabSet::ScratchArena & arena)
+{
+  itk::LabSet::ScratchScope scope(arena);
+
+  const int      MaxLength = 70;
+  const RealType Sigma = 7.3f;
+  const RealType magnitude = ( doDilate ? 1 : -1 ) * 0.7f * 0.7f / ( 2.0f * Sigma );
+  const RealType m_Extreme = doDilate ? -1e30f : 1e30f;
+
+  std::uniform_int_distribution< int >      length(0, MaxLength);
+  std::uniform_real_distribution< RealType > value(0, Sigma);
+  std::uniform_int_distribution< int >      label(0, 3);
+
+  LineType    LineBuf(arena, Lanes * MaxLength), tmpLineBuf(arena, Lanes * MaxLength);
+  LabLineType LabBuf(arena, Lanes * MaxLength), tmpLabBuf(arena, Lanes * MaxLength);
+  LineType    Parabola(arena, MaxLength);
+  itk::LabSet::ScratchBuffer< int > Lengths(arena, Lanes);
+  itk::LabSet::FillParabola(&( Parabola[0] ), MaxLength, magnitude);
+
+  for ( unsigned l = 0; l < Lanes; l++ )
+    {
+    Lengths[l] = length(rng);
+    for ( int pos = 0; pos < MaxLength; pos++ )
+      {
+      LineBuf[pos * Lanes + l] = value(rng);
+      LabBuf[pos * Lanes + l] = label(rng);
+      }
+    }
+
+  LineType    Expected(arena, Lanes * MaxLength);
+  LabLineType ExpectedLab(arena, Lanes * MaxLength);
+  for ( unsigned l = 0; l < Lanes; l++ )
+    {
+    itk::LabSet::ScratchScope lane(arena);
+    LineType    Line(arena, Lengths[l]), tmpLine(arena, Lengths[l]);
+    LabLineType Lab(arena, Lengths[l]), tmpLab(arena, Lengths[l]);
+    for ( int pos = 0; pos < Lengths[l]; pos++ )
+      {
+      Line[pos] = LineBuf[pos * Lanes + l];
+      Lab[pos] = LabBuf[pos * Lanes + l];
+      }
+    if ( doDilate )
+      {
+      itk::LabSet::DoLineLabelProp< LineType, LabLineType, RealType, doDilate >(Line, tmpLine, Lab, tmpLab,
+                                                                                &( Parabola[0] ), m_Extreme);
+      }
+    else
+      {
+      itk::LabSet::DoLine< LineType, RealType, doDilate >(Line, tmpLine, &( Parabola[0] ), m_Extreme);
+      }
+    for ( int pos = 0; pos < Lengths[l]; pos++ )
+      {
+      Expected[pos * Lanes + l] = Line[pos];
+      ExpectedLab[pos * Lanes + l] = Lab[pos];
+      }
+    }
+
+  itk::LabSet::DoLineLanes< RealType, LabelType, doDilate, doDilate >(Lanes, &( LineBuf[0] ), &( tmpLineBuf[0] ),
+                                                                      &( LabBuf[0] ), &( tmpLabBuf[0] ),
+                                                                      &( Lengths[0] ), &( Parabola[0] ), m_Extreme);
+  int failures = 0;
+  for ( unsigned l = 0; l < Lanes; l++ )
+    {
+    for ( int pos = 0; pos < Lengths[l]; pos++ )
+      {
+      if ( !sameBits(LineBuf[pos * Lanes + l], Expected[pos * Lanes + l])
+           || ( doDilate && LabBuf[pos * Lanes + l] != ExpectedLab[pos * Lanes + l] ) )
+        {
+        ++failures;
+        }
+      }
+    }
+  return failures;
+}
+
+int checkFlatLine(std::mt19937 & rng, itk::LabSet::ScratchArena & arena)
+{
+  itk::LabSet::ScratchScope scope(arena);
+
+  const int      LineLength = 70;
+  const RealType magnitude = 0.7f * 0.7f / ( 2.0f * 7.3f );
+
+  std::uniform_real_distribution< RealType > value(0, 7.3f);
+  std::uniform_int_distribution< int >      label(0, 3);
+
+  LineType    Line(arena, LineLength), tmpLine(arena, LineLength), Parabola(arena, LineLength);
+  LabLineType Lab(arena, LineLength), tmpLab(arena, LineLength), Before(arena, LineLength);
+  itk::LabSet::FillParabola(&( Parabola[0] ), LineLength, magnitude);
+
+  const RealType level = value(rng);
+  for ( int pos = 0; pos < LineLength; pos++ )
+    {
+    Line[pos] = level;
+    Lab[pos] = Before[pos] = label(rng);
+    }
+  itk::LabSet::DoLineLabelProp< LineType, LabLineType, RealType, true >(Line, tmpLine, Lab, tmpLab,
+                                                                        &( Parabola[0] ), -1e30f);
+  int failures = 0;
+  for ( int pos = 0; pos < LineLength; pos++ )
+    {
+    failures += !sameBits(Line[pos], level) || Lab[pos] != Before[pos];
+    }
+  return failures;
+}
+}
+
+int itkLabelSetLineLanesTest(int, char *[])
+{
+  std::atomic< itk::SizeValueType > allocations(0);
+  itk::LabSet::ScratchArena         arena(1 << 20, allocations);
+  std::mt19937                      rng(1234);
+
+  int failures = 0;
+  for ( unsigned trial = 0; trial < 200; trial++ )
+    {
+    failures += checkFlatLine(rng, arena);
+    }
+  std::cout << failures << " flat line changes" << std::endl;
+
+  const unsigned Available = itk::LabSet::GetNumberOfLanes();
+  if ( Available == 0 )
+    {
+    std::cout << "No lockstep kernels on this cpu" << std::endl;
+    return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+    }
+  for ( unsigned Lanes = 8; Lanes <= Available; Lanes *= 2 )
+    {
+    for ( unsigned trial = 0; trial < 200; trial++ )
+      {
+      failures += checkLine< true >(Lanes, rng, arena);
+      failures += checkLine< false >(Lanes, rng, arena);
+      }
+    std::cout << Lanes << " lanes, " << failures << " differences" << std::endl;
+    }
+  return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
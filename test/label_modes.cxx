@@ -0,0 +1,423 @@
+/*=========================================================================
+ *
+ *  Copyright Insight Software Consortium
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#ifndef label_modes_cxx
+#define label_modes_cxx
+
+// The modes the dilation and erosion tests run the filters in. Each
+// sets the options of one feature, and afterwards checks what the
+// feature reports about the update, as well as the output being
+// compared with the baseline.
+#include <iomanip>
+#include <vector>
+#include "itkImageFileReader.h"
+#include "itkImageFileWriter.h"
+#include "itkStreamingImageFilter.h"
+#include "itkLabelSetShards.h"
+#include "itkImageAlgorithm.h"
+#include "itkImageRegionIterator.h"
+#include "itkImageRegionConstIteratorWithIndex.h"
+
+#include "read_info.cxx"
+
+// the output of filter produced a box at a time, 3 by 3 across the
+// first two axes, as a viewer showing part of it would ask
+template< typename TImage, typename TFilter >
+typename TImage::Pointer produceInBoxes(TFilter *filter)
+{
+  filter->UpdateOutputInformation();
+  const typename TImage::RegionType Largest = filter->GetOutput()->GetLargestPossibleRegion();
+
+  typename TImage::Pointer result = TImage::New();
+  result->CopyInformation( filter->GetOutput() );
+  result->SetRegions(Largest);
+  result->Allocate();
+  for ( unsigned i = 0; i < 9; i++ )
+    {
+    typename TImage::RegionType box = Largest;
+    for ( unsigned P = 0; P < 2; P++ )
+      {
+      const itk::SizeValueType size = Largest.GetSize()[P];
+      const itk::SizeValueType k = ( P == 0 ) ? i % 3 : i / 3;
+      box.SetIndex( P, Largest.GetIndex()[P] + static_cast< itk::IndexValueType >( size * k / 3 ) );
+      box.SetSize(P, size * ( k + 1 ) / 3 - size * k / 3);
+      }
+    filter->GetOutput()->SetRequestedRegion(box);
+    filter->Update();
+    itk::ImageAlgorithm::Copy(filter->GetOutput(), result.GetPointer(), box, box);
+    }
+  return result;
+}
+
+// whether the labels of image, grown by reach voxels, stay clear of
+// one of its faces
+template< typename TImage >
+bool labelsLeaveRoom(const TImage *image, const itk::SizeValueType reach)
+{
+  const typename TImage::RegionType Largest = image->GetLargestPossibleRegion();
+  typename TImage::IndexType        first = Largest.GetUpperIndex();
+  typename TImage::IndexType        last = Largest.GetIndex();
+  bool                              found = false;
+
+  itk::ImageRegionConstIteratorWithIndex< TImage > it(image, Largest);
+  for ( it.GoToBegin(); !it.IsAtEnd(); ++it )
+    {
+    if ( it.Get() != 0 )
+      {
+      const typename TImage::IndexType idx = it.GetIndex();
+      for ( unsigned P = 0; P < TImage::ImageDimension; P++ )
+        {
+        first[P] = std::min(first[P], idx[P]);
+        last[P] = std::max(last[P], idx[P]);
+        }
+      found = true;
+      }
+    }
+  if ( !found )
+    {
+    return true;
+    }
+  const auto gap = static_cast< itk::IndexValueType >( reach );
+  for ( unsigned P = 0; P < TImage::ImageDimension; P++ )
+    {
+    if ( first[P] - Largest.GetIndex()[P] > gap || Largest.GetUpperIndex()[P] - last[P] > gap )
+      {
+      return true;
+      }
+    }
+  return false;
+}
+
+// the options each mode tests
+template< typename FilterType >
+void setMode(FilterType *filter, const std::string & mode)
+{
+  if ( mode == "envelope" )
+    {
+    filter->SetUseEnvelopeAlgorithm(true);
+    }
+  if ( mode == "simd" )
+    {
+    filter->SetUseVectorization(true);
+    }
+  if ( mode == "integer" || mode == "compact" )
+    {
+    filter->SetUseImageSpacing(false);
+    filter->SetUseIntegerArithmetic(true);
+    filter->SetUseCompactDistanceImage( mode == "compact" );
+    }
+  if ( mode == "interleaved" )
+    {
+    filter->SetUseInterleavedBuffer(true);
+    }
+  if ( mode == "rotated" )
+    {
+    filter->SetUseRotatedLayout(true);
+    }
+  if ( mode == "inplace" )
+    {
+    filter->InPlaceOn();
+    }
+  if ( mode == "slab" )
+    {
+    // thin slabs, so there are many of them
+    filter->SetMemoryPolicy(FilterType::SlabDistanceImage);
+    filter->SetSlabThickness(4);
+    }
+  if ( mode == "release" )
+    {
+    filter->SetMemoryPolicy(FilterType::ReleaseDistanceImage);
+    }
+  if ( mode == "split" )
+    {
+    // more pieces than some axes have cache lines
+    filter->SetNumberOfWorkUnits(64);
+    }
+  if ( mode == "stealing" )
+    {
+    filter->SetNumberOfWorkUnits(8);
+    filter->SetPassScheduling(FilterType::StealingPasses);
+    filter->SetUseCostEstimate(true);
+    }
+  if ( mode == "wavefront" )
+    {
+    filter->SetNumberOfWorkUnits(4);
+    filter->SetPassScheduling(FilterType::WavefrontPasses);
+    }
+  if ( mode == "native" )
+    {
+    filter->SetPassScheduling(FilterType::NativePasses);
+    filter->SetGrainSize(64);
+    }
+  if ( mode == "firsttouch" )
+    {
+    filter->SetNumberOfWorkUnits(4);
+    filter->SetUseFirstTouch(true);
+    filter->SetUseThreadPinning(true);
+    }
+  if ( mode == "hugepages" )
+    {
+    filter->SetUseHugePages(true);
+    filter->SetUseRotatedLayout(true);
+    }
+  if ( mode == "boundingbox" )
+    {
+    filter->SetUseBoundingBox(true);
+    }
+  if ( mode == "narrowband" )
+    {
+    filter->SetNumberOfWorkUnits(4);
+    filter->SetPassScheduling(FilterType::NarrowBandPasses);
+    }
+  if ( mode == "mapped" )
+    {
+    // slabs of about 170 planes of these images, held in temporary
+    // files
+    filter->SetUseMappedFiles(true);
+    filter->SetMemoryPolicy(FilterType::SlabDistanceImage);
+    filter->SetMemoryBudget(32 << 20);
+    }
+  if ( mode == "incremental" )
+    {
+    filter->SetUseIncrementalUpdate(true);
+    }
+  if ( mode == "untiled" )
+    {
+    typename FilterType::TileLinesType tiles;
+    tiles.Fill(1);
+    filter->SetTileLines(tiles);
+    }
+}
+
+// what the feature a mode tests reports about the update
+template< typename FilterType, typename TImage >
+int checkMode(const FilterType *filter, const TImage *input, const double radius, const std::string & mode)
+{
+  // line buffers come from one arena per work unit, not the heap
+  if ( filter->GetNumberOfScratchAllocations() > filter->GetNumberOfWorkUnits() )
+    {
+    std::cerr << "Too many scratch allocations: " << filter->GetNumberOfScratchAllocations() << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  if ( mode == "interleaved" && !filter->GetInterleavedPasses() )
+    {
+    std::cerr << "The distances and labels weren't interleaved" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  if ( mode == "incremental" && !filter->GetUpdatedIncrementally() )
+    {
+    std::cerr << "The update after the edit wasn't incremental" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  // 8 work units can't all run out of blocks at the same moment in
+  // every pass
+  if ( mode == "stealing" && filter->GetNumberOfSteals() == 0 )
+    {
+    std::cerr << "No blocks were stolen" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  // where the kernel takes the advice at all, the distance images of
+  // these volumes are large enough for some of it
+  if ( mode == "hugepages" )
+    {
+    std::vector< char > probe(2 * itk::LabSet::HugePageBytes);
+    if ( itk::LabSet::AdviseHugePages( probe.data(), probe.size() ) && filter->GetNumberOfHugePageBuffers() == 0 )
+      {
+      std::cerr << "No buffers were backed by huge pages" << std::endl;
+      return EXIT_FAILURE;
+      }
+    }
+
+  // the passes skip the image away from the labels, unless the
+  // labels come close to every face of it
+  const itk::SizeValueType Voxels = filter->GetOutput()->GetLargestPossibleRegion().GetNumberOfPixels();
+  if ( mode == "boundingbox" && filter->GetNumberOfPassVoxels() >= Voxels
+       && labelsLeaveRoom( input, static_cast< itk::SizeValueType >( 2 * radius + 2 ) ) )
+    {
+    std::cerr << "The passes covered the whole image: " << filter->GetNumberOfPassVoxels() << std::endl;
+    return EXIT_FAILURE;
+    }
+  // and the narrow band is some of the image, but not all of it
+  if ( mode == "narrowband" && ( filter->GetNumberOfBandVoxels() == 0 || filter->GetNumberOfBandVoxels() >= Voxels ) )
+    {
+    std::cerr << "The narrow band wasn't narrow: " << filter->GetNumberOfBandVoxels() << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  // the shards ran in other processes
+  if ( mode != "sharded" && filter->GetPeakMemoryBytes() == 0 )
+    {
+    std::cerr << "No peak memory reported" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  return EXIT_SUCCESS;
+}
+
+// a filter of type TFilter with mode's options, writing its output
+// to Out
+template< template< typename, typename > class TFilter, class MaskPixType, int dim >
+int runMode(char *In, char *Out, double radius, const std::string & mode)
+{
+  using MaskImType = typename itk::Image< MaskPixType, dim >;
+
+  // load
+  using ReaderType = typename itk::ImageFileReader< MaskImType >;
+  typename ReaderType::Pointer reader = ReaderType::New();
+  reader->SetFileName(In);
+  try
+    {
+    reader->Update();
+    }
+  catch ( itk::ExceptionObject & excp )
+    {
+    std::cerr << excp << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  using FilterType = TFilter< MaskImType, MaskImType >;
+  typename FilterType::Pointer filter = FilterType::New();
+  filter->SetInput( reader->GetOutput() );
+  filter->SetRadius(radius);
+  filter->SetUseImageSpacing(true);
+  setMode(filter.GetPointer(), mode);
+
+  using WriterType = typename itk::ImageFileWriter< MaskImType >;
+  typename WriterType::Pointer writer = WriterType::New();
+  // pieces along z, each computed from its own padded input
+  using StreamerType = typename itk::StreamingImageFilter< MaskImType, MaskImType >;
+  typename StreamerType::Pointer streamer = StreamerType::New();
+  streamer->SetInput( filter->GetOutput() );
+  streamer->SetNumberOfStreamDivisions(5);
+  if ( mode == "streaming" )
+    {
+    writer->SetInput( streamer->GetOutput() );
+    }
+  else
+    {
+    writer->SetInput( filter->GetOutput() );
+    }
+  writer->SetFileName(Out);
+  try
+    {
+    if ( mode == "repeat" )
+      {
+      // the second update reuses the distance image
+      filter->Update();
+      filter->Modified();
+      }
+    if ( mode == "incremental" )
+      {
+      // the first update sees a box in the middle of the input
+      // cleared, which is then put back and marked
+      typename MaskImType::Pointer    input = reader->GetOutput();
+      typename MaskImType::RegionType box = input->GetLargestPossibleRegion();
+      for ( unsigned P = 0; P < dim; P++ )
+        {
+        const itk::SizeValueType size = box.GetSize()[P];
+        box.SetIndex( P, box.GetIndex()[P] + static_cast< itk::IndexValueType >( size * 3 / 8 ) );
+        box.SetSize(P, size / 4);
+        }
+      std::vector< MaskPixType >             saved;
+      itk::ImageRegionIterator< MaskImType > it(input, box);
+      for ( it.GoToBegin(); !it.IsAtEnd(); ++it )
+        {
+        saved.push_back( it.Get() );
+        it.Set(0);
+        }
+      filter->Update();
+      auto value = saved.begin();
+      for ( it.GoToBegin(); !it.IsAtEnd(); ++it )
+        {
+        it.Set(*value++);
+        }
+      input->Modified();
+      filter->AddDirtyRegion(box);
+      }
+    if ( mode == "roi" )
+      {
+      writer->SetInput( produceInBoxes< MaskImType >( filter.GetPointer() ) );
+      }
+    if ( mode == "sharded" )
+      {
+      // three processes, a third of the planes each
+      writer->SetInput( itk::LabSet::ShardedUpdate(filter.GetPointer(), 3) );
+      }
+    writer->Update();
+    }
+  catch ( itk::ExceptionObject & excp )
+    {
+    std::cerr << excp << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  return checkMode( filter.GetPointer(), reader->GetOutput(), radius, mode );
+}
+
+// the test driver's entry point for the filters of type TFilter:
+// inputimage radius outputimage [mode]
+template< template< typename, typename > class TFilter >
+int labelModeTest(int argc, char *argv[])
+{
+  int dim1;
+
+  itk::ImageIOBase::IOComponentType ComponentType;
+
+  if ( argc != 4 && argc != 5 )
+    {
+    std::cerr << "Usage: " << argv[0] << "inputimage radius outputimage [mode]" << std::endl;
+    return ( EXIT_FAILURE );
+    }
+
+  if ( !readImageInfo(argv[1], &ComponentType, &dim1) )
+    {
+    std::cerr << "Failed to open " << argv[1] << std::endl;
+    return ( EXIT_FAILURE );
+    }
+
+  const std::string mode = ( argc == 5 ) ? argv[4] : "";
+
+  // one thread, except for the modes that share a pass out between
+  // work units, which need threads to run them side by side
+  const bool concurrent = mode == "split" || mode == "stealing" || mode == "wavefront" || mode == "native"
+                          || mode == "firsttouch" || mode == "narrowband";
+  itk::MultiThreaderBase::SetGlobalMaximumNumberOfThreads(concurrent ? 8 : 1);
+
+  int status = EXIT_FAILURE;
+  switch ( dim1 )
+    {
+    case 2:
+      status = runMode< TFilter, unsigned char, 2 >( argv[1], argv[3], std::stod(argv[2]), mode );
+      break;
+    case 3:
+      status = runMode< TFilter, unsigned char, 3 >( argv[1], argv[3], std::stod(argv[2]), mode );
+      break;
+    default:
+      std::cerr << "Unsupported dimension" << std::endl;
+      return ( EXIT_FAILURE );
+      break;
+    }
+  return status;
+}
+
+/////////////////////////////////
+#endif
@@ -0,0 +1,32 @@
+#!/bin/bash
+
+# Local against interleaved placement of the filter's buffers on a
+# multi socket machine. "main" leaves the pages where the main
+# thread's first pass puts them, "interleave" spreads them over the
+# nodes with numactl, and "local" has the pinned work units touch
+# their own shares first.
+
+REP=5
+IM=../images/HarvardOxford-cort-maxprob-thr50-1mm.nii.gz
+
+echo "numa placement" > numa.log
+for th in 8 16 32 ; do
+
+    for rad in 2 5 10 20; do
+        echo $th $rad
+        OPTIONS="--repetitions $REP --threads $th -r $rad -i $IM -o /tmp/tt.nii.gz"
+
+        echo "main" >> numa.log
+        ./labelSetsDilateNumaPerf $OPTIONS >> numa.log
+        echo "interleave" >> numa.log
+        numactl --interleave=all ./labelSetsDilateNumaPerf $OPTIONS >> numa.log
+        echo "local" >> numa.log
+        ./labelSetsDilateNumaPerf $OPTIONS --first-touch --pin >> numa.log
+
+    done
+
+done
+
+hd=$(grep "^Iterations" numa.log | head -1)
+echo "placement,$hd" > numa.csv
+awk -v rep=$REP '/^(main|interleave|local)$/ {p=$1} $0 ~ "^"rep"," {print p "," $0}' numa.log >> numa.csv
@@ -0,0 +1,26 @@
+#!/bin/bash
+
+# TLB misses of the pass along z with and without transparent huge
+# pages for the distance image. The radius is along z only, so the
+# other passes do nothing. Needs perf and an image of a few hundred
+# megabytes or more for the difference to show.
+
+REP=5
+IM=${1:-../images/HarvardOxford-cort-maxprob-thr50-1mm.nii.gz}
+EVENTS=dTLB-loads,dTLB-load-misses,dTLB-stores,dTLB-store-misses
+
+echo "huge pages" > tlb.log
+for th in 1 8 ; do
+
+    for rad in 5 20; do
+        echo $th $rad
+        OPTIONS="--repetitions $REP --threads $th -r $rad -i $IM -o /tmp/tt.nii.gz"
+
+        perf stat -x, -e $EVENTS -o tlb_off_${th}_${rad}.csv ./labelSetsDilateZPassPerf $OPTIONS >> tlb.log
+        perf stat -x, -e $EVENTS -o tlb_on_${th}_${rad}.csv ./labelSetsDilateZPassPerf $OPTIONS --huge-pages >> tlb.log
+
+    done
+
+done
+
+grep "dTLB" tlb_*.csv